@@ -10,35 +10,58 @@
  */
 
 #include <linux/acpi.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/hwmon.h>
 #include <linux/hwmon-sysfs.h>
+#include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/input.h>
+#include <linux/jiffies.h>
 #include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/leds.h>
+#include <linux/lockdep.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/notifier.h>
 #include <linux/pci_ids.h>
+#include <linux/percpu.h>
 #include <linux/power_supply.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
 #include <linux/sysfs.h>
+#include <linux/thermal.h>
 #include <linux/types.h>
+#include <linux/units.h>
+#include <linux/workqueue.h>
+#include <net/genetlink.h>
 #include <linux/dmi.h>
 #include <linux/platform_device.h>
+#include <linux/pm.h>
 #include <linux/platform_data/cros_ec_proto.h>
 #include <linux/platform_data/cros_ec_commands.h>
 #include <linux/version.h>
 
 #include <acpi/battery.h>
 
-#define DRV_NAME "framework_laptop"
-#define FRAMEWORK_LAPTOP_EC_DEVICE_NAME "cros-ec-dev"
+#define CREATE_TRACE_POINTS
+#include "framework_laptop_trace.h"
 
-static struct platform_device *fwdevice;
-static struct device *ec_device;
-struct framework_data {
-	struct platform_device *pdev;
-	struct led_classdev kb_led;
-	struct device *hwmon_dev;
-};
+#include "framework_laptop.h"
+
+#define DRV_NAME "framework_laptop"
+// The EC transport driver, whose device carries the cros_ec_device
+#ifdef FRAMEWORK_LAPTOP_FAKE
+#define FRAMEWORK_LAPTOP_EC_DRIVER_NAME DRV_NAME "_fake_ec"
+#else
+#define FRAMEWORK_LAPTOP_EC_DRIVER_NAME "cros_ec_lpcs"
+#endif
 
 #define EC_CMD_CHARGE_LIMIT_CONTROL 0x3E03
 
@@ -72,7 +95,466 @@ struct ec_response_privacy_switches_check {
 	uint8_t camera;
 } __ec_align1;
 
-static int charge_limit_control(enum ec_chg_limit_control_modes modes, uint8_t max_percentage) {
+// EC commands the driver relies on, each a command at a given version
+enum fw_cap {
+	FW_CAP_CHARGE_LIMIT,
+	FW_CAP_KB_LED_GET,
+	FW_CAP_KB_LED_SET,
+	FW_CAP_FAN_TARGET_SET_V0,
+	FW_CAP_FAN_TARGET_SET_V1,
+	FW_CAP_FAN_TARGET_GET,
+	FW_CAP_FAN_AUTO_V0,
+	FW_CAP_FAN_AUTO_V1,
+	FW_CAP_FAN_DUTY_V0,
+	FW_CAP_FAN_DUTY_V1,
+	FW_CAP_PRIVACY,
+	FW_CAP_TEMP_INFO,
+	FW_CAP_THERMAL_THRESHOLD,
+	FW_CAP_COUNT
+};
+
+static struct platform_device *fwdevice;
+
+static unsigned int memmap_cache_ms = 100;
+module_param(memmap_cache_ms, uint, 0644);
+MODULE_PARM_DESC(memmap_cache_ms,
+		 "Maximum age in ms of the cached EC fan and temperature readings (0 disables caching)");
+
+static unsigned int kb_led_interval_ms = 50;
+module_param(kb_led_interval_ms, uint, 0644);
+MODULE_PARM_DESC(kb_led_interval_ms,
+		 "Minimum interval in ms between keyboard backlight writes to the EC");
+
+static unsigned int privacy_poll_ms = 1000;
+module_param(privacy_poll_ms, uint, 0644);
+MODULE_PARM_DESC(privacy_poll_ms,
+		 "Privacy switch poll interval in ms when the EC has no event support (0 disables polling)");
+
+static unsigned int fan_curve_interval_ms = 1000;
+module_param(fan_curve_interval_ms, uint, 0644);
+MODULE_PARM_DESC(fan_curve_interval_ms,
+		 "Fan curve evaluation interval in ms (minimum 100)");
+
+static unsigned int fan_curve_hysteresis = 3;
+module_param(fan_curve_hysteresis, uint, 0644);
+MODULE_PARM_DESC(fan_curve_hysteresis,
+		 "Duty change in percent the fan curve ignores before updating the EC");
+
+static bool fan_force_write;
+module_param(fan_force_write, bool, 0644);
+MODULE_PARM_DESC(fan_force_write,
+		 "Send fan duty and target writes to the EC even when they match the last value written");
+
+static unsigned int sample_interval_ms = 100;
+module_param(sample_interval_ms, uint, 0644);
+MODULE_PARM_DESC(sample_interval_ms,
+		 "Telemetry refresh interval in ms while /dev/framework_laptop is open (minimum 10)");
+
+static unsigned int event_poll_ms = 1000;
+module_param(event_poll_ms, uint, 0444);
+MODULE_PARM_DESC(event_poll_ms,
+		 "Interval in ms at which fan states and the charge limit are sampled for alarms and change notifications (0 disables sampling)");
+
+static unsigned int fan_stall_debounce = 2;
+module_param(fan_stall_debounce, uint, 0644);
+MODULE_PARM_DESC(fan_stall_debounce,
+		 "Consecutive samples of a stalled or missing fan before fanN_alarm or fanN_fault is raised (minimum 1)");
+
+static bool thermal_fan_control;
+module_param(thermal_fan_control, bool, 0444);
+MODULE_PARM_DESC(thermal_fan_control,
+		 "Give the EC thermal zones a fan trip point and bind the fans to them, so that the kernel's thermal governors drive fans left in automatic mode (6.12 and newer)");
+
+static unsigned int thermal_poll_ms = 1000;
+module_param(thermal_poll_ms, uint, 0444);
+MODULE_PARM_DESC(thermal_poll_ms,
+		 "Polling interval in ms of the EC thermal zones with a fan trip point");
+
+// Temperatures and fan speeds, laid out as in the EC memory map so both can
+// be fetched with a single read
+struct fw_memmap_snapshot {
+	u8 temps[EC_TEMP_SENSOR_ENTRIES];
+	u16 fans[EC_FAN_SPEED_ENTRIES];
+} __packed;
+
+static_assert(offsetof(struct fw_memmap_snapshot, fans) ==
+	      EC_MEMMAP_FAN - EC_MEMMAP_TEMP_SENSOR);
+
+// Snapshot of the EC memory map, shared by every fan and temperature attribute
+struct fw_memmap_cache {
+	unsigned long timestamp; // jiffies of the last EC read
+	bool valid;
+	struct fw_memmap_snapshot snap;
+	u64 hits;
+	u64 reads;
+};
+
+struct framework_data;
+
+// pwmN_enable values
+#define FW_PWM_ENABLE_FULL 0
+#define FW_PWM_ENABLE_MANUAL 1
+#define FW_PWM_ENABLE_AUTO 2
+#define FW_PWM_ENABLE_CURVE 3
+// Driven by a thermal governor through the fan's cooling device, read-only
+#define FW_PWM_ENABLE_THERMAL 4
+
+// Control mode of a fan and the last values written to it, used to drop
+// writes that change nothing
+struct fw_fan_shadow {
+	u8 mode; // FW_PWM_ENABLE_*
+	bool duty_valid;
+	bool target_valid;
+	u32 duty;
+	u32 target;
+	u64 duty_suppressed;
+	u64 target_suppressed;
+};
+
+// Debounced fan state, sampled every event_poll_ms
+struct fw_fan_monitor {
+	unsigned int stall_samples; // consecutive stalled samples
+	unsigned int fault_samples; // consecutive missing samples
+	bool stalled; // debounced stall in progress
+	bool alarm; // latched, cleared by reading fanN_alarm once the stall ended
+	bool fault;
+	u64 stall_start; // ktime of the first stalled sample
+	u64 episodes;
+	u64 stall_total_ns;
+	u64 stall_max_ns;
+};
+
+#define FW_CURVE_POINTS 5
+
+struct fw_curve_point {
+	int temp; // millidegrees Celsius
+	u8 pwm; // percent
+};
+
+// Temperature to duty table of one fan, evaluated by curve_work
+struct fw_fan_curve {
+	struct fw_curve_point points[FW_CURVE_POINTS]; // ascending temperatures
+	unsigned long channels; // driving sensors, 0 for all of them
+	int duty; // last duty written by the engine, see FW_CURVE_DUTY_*
+};
+
+// Cooling device backed by one fan
+struct fw_fan_cooling {
+	struct framework_data *data;
+	u8 idx;
+	unsigned long state; // last state set, 0 is EC automatic control
+};
+
+// Thermal zone backed by one EC temperature sensor
+struct fw_temp_zone {
+	struct framework_data *data;
+	u8 idx;
+};
+
+// /dev/framework_laptop, which open files keep around after the device is
+// gone
+struct fw_chardev {
+	struct kref ref; // held by the device and by every open file
+	struct miscdevice misc;
+	int id;
+	char name[32];
+	struct mutex lock; // protects data, taken before data->lock
+	struct framework_data *data; // NULL once the device is gone
+};
+
+struct framework_data {
+	struct platform_device *pdev;
+	struct device *ec_dev; // EC transport device, we hold a reference
+	struct cros_ec_device *ec;
+	struct fw_ec_stats __percpu *stats;
+	DECLARE_BITMAP(caps, FW_CAP_COUNT); // see enum fw_cap
+
+	struct acpi_battery_hook battery_hook;
+	struct power_supply *battery; // BAT1 while it has our attribute
+	struct device_attribute charge_attr;
+	struct attribute *battery_attrs[2];
+	struct attribute_group battery_group;
+	const struct attribute_group *battery_groups[2];
+
+	struct led_classdev kb_led;
+	struct delayed_work kb_led_work;
+	// Protects the pending and cached brightness and kb_led_gen, which
+	// kb_led_set_async updates without sleeping
+	spinlock_t kb_led_state_lock;
+	enum led_brightness kb_led_pending; // latest requested brightness
+	unsigned long kb_led_last_flush; // jiffies of the last EC write
+	enum led_brightness kb_led_brightness; // last known EC brightness
+	unsigned int kb_led_gen; // bumped by every brightness request
+	unsigned int kb_led_gen_written; // request last sent, under lock
+	struct work_struct kb_led_sync_work;
+	struct device *hwmon_dev;
+	size_t fan_count;
+	unsigned long temp_present; // sensors the EC reported at probe time
+	const char *temp_labels[EC_TEMP_SENSOR_ENTRIES];
+	struct fw_fan_cooling cooling[EC_FAN_SPEED_ENTRIES];
+	struct fw_temp_zone zones[EC_TEMP_SENSOR_ENTRIES];
+	struct fw_fan_shadow shadows[EC_FAN_SPEED_ENTRIES];
+	struct fw_fan_monitor monitors[EC_FAN_SPEED_ENTRIES];
+	bool fan_monitor_valid; // monitors reflect recent samples
+	struct fw_fan_curve curves[EC_FAN_SPEED_ENTRIES];
+	struct delayed_work curve_work;
+	struct dentry *debugfs;
+	struct notifier_block ec_notifier;
+
+	// Serializes EC access by this instance and protects the state below
+	struct mutex lock;
+	struct fw_memmap_cache memmap;
+	int charge_limit; // last limit reported by the EC, < 0 if unknown
+	int charge_limit_seen; // last limit pollers were told about
+	struct ec_response_privacy_switches_check privacy;
+	bool privacy_valid;
+
+	struct fw_chardev *chardev;
+	struct framework_laptop_telemetry *telemetry; // page shared with userspace
+	struct delayed_work telemetry_work;
+	unsigned int telemetry_users; // open files, the sampler runs while > 0
+	struct framework_laptop_telemetry nl_last; // last state broadcast
+	bool nl_last_valid;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 6, 0)
+	struct delayed_work nl_watch_work;
+#endif
+
+	struct input_dev *privacy_input;
+	struct delayed_work privacy_work;
+	bool privacy_poll; // the EC can't notify us of switch changes
+
+	// Change notifications, see framework_event_work_fn
+	struct delayed_work event_work;
+};
+
+// --- EC command instrumentation ---
+static const struct {
+	u16 command;
+	const char *name;
+} fw_ec_cmd_names[] = {
+	{ EC_CMD_CHARGE_LIMIT_CONTROL, "charge_limit_control" },
+	{ EC_CMD_PWM_GET_DUTY, "pwm_get_duty" },
+	{ EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT, "pwm_set_keyboard_backlight" },
+	{ EC_CMD_PWM_SET_FAN_TARGET_RPM, "pwm_set_fan_target_rpm" },
+	{ EC_CMD_PWM_GET_FAN_TARGET_RPM, "pwm_get_fan_target_rpm" },
+	{ EC_CMD_THERMAL_AUTO_FAN_CTRL, "thermal_auto_fan_ctrl" },
+	{ EC_CMD_PWM_SET_FAN_DUTY, "pwm_set_fan_duty" },
+	{ EC_CMD_PRIVACY_SWITCHES_CHECK_MODE, "privacy_switches_check_mode" },
+	{ EC_CMD_TEMP_SENSOR_GET_INFO, "temp_sensor_get_info" },
+	{ EC_CMD_THERMAL_GET_THRESHOLD, "thermal_get_threshold" },
+	{ EC_CMD_GET_CMD_VERSIONS, "get_cmd_versions" },
+};
+
+// Memmap reads and unlisted commands get their own slots after the table
+#define FW_EC_STAT_READMEM ARRAY_SIZE(fw_ec_cmd_names)
+#define FW_EC_STAT_OTHER (FW_EC_STAT_READMEM + 1)
+#define FW_EC_STAT_SLOTS (FW_EC_STAT_OTHER + 1)
+
+// Bucket 0 is < 1us, bucket N is [2^(N-1), 2^N) us, the last is open-ended
+#define FW_EC_LAT_BUCKETS 16
+
+struct fw_ec_cmd_stats {
+	u64 calls;
+	u64 errors;
+	u64 total_ns;
+	u64 max_ns;
+	u64 buckets[FW_EC_LAT_BUCKETS];
+};
+
+struct fw_ec_stats {
+	struct fw_ec_cmd_stats cmd[FW_EC_STAT_SLOTS];
+};
+
+static unsigned int fw_ec_stat_slot(u32 command)
+{
+	for (unsigned int i = 0; i < ARRAY_SIZE(fw_ec_cmd_names); i++) {
+		if (fw_ec_cmd_names[i].command == command)
+			return i;
+	}
+
+	return FW_EC_STAT_OTHER;
+}
+
+static void fw_ec_record(struct framework_data *data, unsigned int slot,
+			 u64 ns, int ret)
+{
+	struct fw_ec_cmd_stats *stats;
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int bucket;
+
+	bucket = us ? min_t(unsigned int, ilog2(us) + 1, FW_EC_LAT_BUCKETS - 1)
+		    : 0;
+
+	// Each CPU only ever touches its own copy, no locking needed
+	stats = &get_cpu_ptr(data->stats)->cmd[slot];
+	stats->calls++;
+	if (ret < 0)
+		stats->errors++;
+	stats->total_ns += ns;
+	if (ns > stats->max_ns)
+		stats->max_ns = ns;
+	stats->buckets[bucket]++;
+	put_cpu_ptr(data->stats);
+}
+
+static int fw_ec_cmd_xfer_status(struct framework_data *data,
+				 struct cros_ec_command *msg)
+{
+	u64 start, duration;
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	trace_ec_cmd_start(msg->command, msg->version, msg->outsize,
+			   msg->insize);
+	start = ktime_get_ns();
+
+	ret = cros_ec_cmd_xfer_status(data->ec, msg);
+
+	duration = ktime_get_ns() - start;
+	fw_ec_record(data, fw_ec_stat_slot(msg->command), duration, ret);
+	trace_ec_cmd_end(msg->command, msg->version, msg->outsize, msg->insize,
+			 ret, duration);
+
+	return ret;
+}
+
+static int fw_ec_cmd(struct framework_data *data, unsigned int version,
+		     int command, void *outdata, size_t outsize, void *indata,
+		     size_t insize)
+{
+	u64 start, duration;
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	trace_ec_cmd_start(command, version, outsize, insize);
+	start = ktime_get_ns();
+
+	ret = cros_ec_cmd(data->ec, version, command, outdata, outsize, indata,
+			  insize);
+
+	duration = ktime_get_ns() - start;
+	fw_ec_record(data, fw_ec_stat_slot(command), duration, ret);
+	trace_ec_cmd_end(command, version, outsize, insize, ret, duration);
+
+	return ret;
+}
+
+static int fw_ec_readmem(struct framework_data *data, unsigned int offset,
+			 unsigned int bytes, void *dest)
+{
+	u64 start, duration;
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	start = ktime_get_ns();
+
+	ret = data->ec->cmd_readmem(data->ec, offset, bytes, dest);
+
+	duration = ktime_get_ns() - start;
+	fw_ec_record(data, FW_EC_STAT_READMEM, duration, ret);
+	trace_ec_readmem(offset, bytes, ret, duration);
+
+	return ret;
+}
+
+// --- EC capabilities ---
+// Entries for the same command are kept next to each other, so each command
+// is only queried once
+static const struct {
+	u16 command;
+	u8 version;
+	const char *name;
+} fw_caps[FW_CAP_COUNT] = {
+	[FW_CAP_CHARGE_LIMIT] = { EC_CMD_CHARGE_LIMIT_CONTROL, 0, "charge_limit" },
+	[FW_CAP_KB_LED_GET] = { EC_CMD_PWM_GET_DUTY, 0, "kb_led_get" },
+	[FW_CAP_KB_LED_SET] = { EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT, 0, "kb_led_set" },
+	[FW_CAP_FAN_TARGET_SET_V0] = { EC_CMD_PWM_SET_FAN_TARGET_RPM, 0, "fan_target_set_v0" },
+	[FW_CAP_FAN_TARGET_SET_V1] = { EC_CMD_PWM_SET_FAN_TARGET_RPM, 1, "fan_target_set_v1" },
+	[FW_CAP_FAN_TARGET_GET] = { EC_CMD_PWM_GET_FAN_TARGET_RPM, 0, "fan_target_get" },
+	[FW_CAP_FAN_AUTO_V0] = { EC_CMD_THERMAL_AUTO_FAN_CTRL, 0, "fan_auto_v0" },
+	[FW_CAP_FAN_AUTO_V1] = { EC_CMD_THERMAL_AUTO_FAN_CTRL, 1, "fan_auto_v1" },
+	[FW_CAP_FAN_DUTY_V0] = { EC_CMD_PWM_SET_FAN_DUTY, 0, "fan_duty_v0" },
+	[FW_CAP_FAN_DUTY_V1] = { EC_CMD_PWM_SET_FAN_DUTY, 1, "fan_duty_v1" },
+	[FW_CAP_PRIVACY] = { EC_CMD_PRIVACY_SWITCHES_CHECK_MODE, 0, "privacy" },
+	[FW_CAP_TEMP_INFO] = { EC_CMD_TEMP_SENSOR_GET_INFO, 0, "temp_info" },
+	[FW_CAP_THERMAL_THRESHOLD] = { EC_CMD_THERMAL_GET_THRESHOLD, 1, "thermal_threshold" },
+};
+
+static int ec_get_cmd_versions(struct framework_data *data, u16 command,
+			       u32 *mask)
+{
+	int ret;
+
+	struct ec_params_get_cmd_versions_v1 params = {
+		.cmd = command,
+	};
+	struct ec_response_get_cmd_versions resp;
+
+	ret = fw_ec_cmd(data, 1, EC_CMD_GET_CMD_VERSIONS, &params,
+			sizeof(params), &resp, sizeof(resp));
+	if (ret < 0)
+		return -EIO;
+
+	*mask = resp.version_mask;
+
+	return 0;
+}
+
+// Ask the EC once which command versions it implements, so handlers pick
+// a version up front and unsupported features are never exposed
+static void framework_scan_caps(struct framework_data *data)
+{
+	u32 mask = 0;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	// An EC that can't tell us gets the benefit of the doubt, as before
+	if (ec_get_cmd_versions(data, EC_CMD_GET_CMD_VERSIONS, &mask) < 0 ||
+	    !(mask & EC_VER_MASK(1))) {
+		dev_dbg(&data->pdev->dev,
+			"EC can't report command versions, assuming all are supported\n");
+		bitmap_fill(data->caps, FW_CAP_COUNT);
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < FW_CAP_COUNT; i++) {
+		if (!i || fw_caps[i].command != fw_caps[i - 1].command) {
+			ret = ec_get_cmd_versions(data, fw_caps[i].command,
+						  &mask);
+			// Unknown commands are reported as an error
+			if (ret < 0)
+				mask = 0;
+		}
+
+		if (mask & EC_VER_MASK(fw_caps[i].version))
+			__set_bit(i, data->caps);
+	}
+
+out:
+	mutex_unlock(&data->lock);
+}
+
+static bool fw_has(const struct framework_data *data, enum fw_cap cap)
+{
+	return test_bit(cap, data->caps);
+}
+
+// Version 0 of the fan commands has no fan index and applies to every fan,
+// which only amounts to the same thing with a single fan
+static bool fw_has_fan_cmd(const struct framework_data *data, enum fw_cap v0,
+			   enum fw_cap v1)
+{
+	return fw_has(data, v1) || (fw_has(data, v0) && data->fan_count == 1);
+}
+
+static int charge_limit_control(struct framework_data *data,
+				enum ec_chg_limit_control_modes modes,
+				uint8_t max_percentage)
+{
 	struct {
 		struct cros_ec_command msg;
 		union {
@@ -83,14 +565,8 @@ static int charge_limit_control(enum ec_chg_limit_control_modes modes, uint8_t m
 	struct ec_params_ec_chg_limit_control *params = &buf.params;
 	struct ec_response_chg_limit_control *resp = &buf.resp;
 	struct cros_ec_command *msg = &buf.msg;
-	struct cros_ec_device *ec;
 	int ret;
 
-	if (!ec_device)
-		return -ENODEV;
-
-	ec = dev_get_drvdata(ec_device);
-
 	memset(&buf, 0, sizeof(buf));
 
 	msg->version = 0;
@@ -101,7 +577,7 @@ static int charge_limit_control(enum ec_chg_limit_control_modes modes, uint8_t m
 	params->modes = modes;
 	params->max_percentage = max_percentage;
 
-	ret = cros_ec_cmd_xfer_status(ec, msg);
+	ret = fw_ec_cmd_xfer_status(data, msg);
 	if (ret < 0) {
 		return -EIO;
 	}
@@ -109,8 +585,8 @@ static int charge_limit_control(enum ec_chg_limit_control_modes modes, uint8_t m
 	return resp->max_percentage;
 }
 
-// Get the last set keyboard LED brightness
-static enum led_brightness kb_led_get(struct led_classdev *led)
+// Query the keyboard LED brightness from the EC
+static int ec_get_kb_led_brightness(struct framework_data *data)
 {
 	struct {
 		struct cros_ec_command msg;
@@ -123,12 +599,7 @@ static enum led_brightness kb_led_get(struct led_classdev *led)
 	struct ec_params_pwm_get_duty *p = &buf.p;
 	struct ec_response_pwm_get_duty *resp = &buf.resp;
 	struct cros_ec_command *msg = &buf.msg;
-	struct cros_ec_device *ec;
 	int ret;
-	if (!ec_device)
-		goto out;
-
-	ec = dev_get_drvdata(ec_device);
 
 	memset(&buf, 0, sizeof(buf));
 
@@ -139,19 +610,26 @@ static enum led_brightness kb_led_get(struct led_classdev *led)
 	msg->insize = sizeof(*resp);
 	msg->outsize = sizeof(*p);
 
-	ret = cros_ec_cmd_xfer_status(ec, msg);
+	ret = fw_ec_cmd_xfer_status(data, msg);
 	if (ret < 0) {
-		goto out;
+		return -EIO;
 	}
 
 	return resp->duty * 100 / EC_PWM_MAX_DUTY;
+}
 
-out:
-	return 0;
+// Get the last set keyboard LED brightness
+static enum led_brightness kb_led_get(struct led_classdev *led)
+{
+	struct framework_data *data =
+		container_of(led, struct framework_data, kb_led);
+
+	return READ_ONCE(data->kb_led_brightness);
 }
 
 // Set the keyboard LED brightness
-static int kb_led_set(struct led_classdev *led, enum led_brightness value)
+static int ec_set_kb_led_brightness(struct framework_data *data,
+				    enum led_brightness value)
 {
 	struct {
 		struct cros_ec_command msg;
@@ -162,14 +640,8 @@ static int kb_led_set(struct led_classdev *led, enum led_brightness value)
 
 	struct ec_params_pwm_set_keyboard_backlight *params = &buf.params;
 	struct cros_ec_command *msg = &buf.msg;
-	struct cros_ec_device *ec;
 	int ret;
 
-	if (!ec_device)
-		return -EIO;
-
-	ec = dev_get_drvdata(ec_device);
-
 	memset(&buf, 0, sizeof(buf));
 	
 	msg->version = 0;
@@ -179,7 +651,7 @@ static int kb_led_set(struct led_classdev *led, enum led_brightness value)
 
 	params->percent = value;
 
-	ret = cros_ec_cmd_xfer_status(ec, msg);
+	ret = fw_ec_cmd_xfer_status(data, msg);
 	if (ret < 0) {
 		return -EIO;
 	}
@@ -187,19 +659,197 @@ static int kb_led_set(struct led_classdev *led, enum led_brightness value)
 	return 0;
 }
 
+// Write the latest requested brightness to the EC
+static void kb_led_work_fn(struct work_struct *work)
+{
+	struct framework_data *data =
+		container_of(to_delayed_work(work), struct framework_data,
+			     kb_led_work);
+	enum led_brightness value;
+	unsigned int gen;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	spin_lock_irq(&data->kb_led_state_lock);
+	value = data->kb_led_pending;
+	gen = data->kb_led_gen;
+	spin_unlock_irq(&data->kb_led_state_lock);
+
+	WRITE_ONCE(data->kb_led_last_flush, jiffies);
+	ret = ec_set_kb_led_brightness(data, value);
+	// Even if it failed, the sync below can compare against the EC again
+	data->kb_led_gen_written = gen;
+
+	mutex_unlock(&data->lock);
+
+	// The cache already holds the new value, put the EC's back
+	if (ret < 0) {
+		dev_warn_ratelimited(&data->pdev->dev,
+				     "failed to set keyboard backlight: %d\n",
+				     ret);
+		schedule_work(&data->kb_led_sync_work);
+	}
+}
+
+// Record the brightness and let the worker flush it, so that a burst of
+// writes costs at most one EC command per kb_led_interval_ms
+static void kb_led_set_async(struct led_classdev *led,
+			     enum led_brightness value)
+{
+	struct framework_data *data =
+		container_of(led, struct framework_data, kb_led);
+	unsigned long next, now = jiffies;
+	unsigned long delay = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&data->kb_led_state_lock, flags);
+	data->kb_led_pending = value;
+	WRITE_ONCE(data->kb_led_brightness, value);
+	data->kb_led_gen++;
+	spin_unlock_irqrestore(&data->kb_led_state_lock, flags);
+
+	next = READ_ONCE(data->kb_led_last_flush) +
+	       msecs_to_jiffies(kb_led_interval_ms);
+	if (time_before(now, next))
+		delay = next - now;
+
+	// An already queued flush will pick up the new value
+	schedule_delayed_work(&data->kb_led_work, delay);
+}
+
+// Re-read the brightness from the EC, which may have changed it in response
+// to the backlight hotkey
+static void kb_led_sync_work_fn(struct work_struct *work)
+{
+	struct framework_data *data =
+		container_of(work, struct framework_data, kb_led_sync_work);
+	bool changed = false;
+	int brightness;
+
+	// Holding the lock keeps a flush from completing between the read and
+	// the comparison
+	mutex_lock(&data->lock);
+
+	brightness = ec_get_kb_led_brightness(data);
+	if (brightness >= 0) {
+		spin_lock_irq(&data->kb_led_state_lock);
+		// A write that is queued or in flight takes precedence
+		if (data->kb_led_gen == data->kb_led_gen_written &&
+		    brightness != data->kb_led_brightness) {
+			WRITE_ONCE(data->kb_led_brightness, brightness);
+			changed = true;
+		}
+		spin_unlock_irq(&data->kb_led_state_lock);
+	}
+
+	mutex_unlock(&data->lock);
+
+	if (changed)
+		led_classdev_notify_brightness_hw_changed(&data->kb_led,
+							  brightness);
+}
+
+static void kb_led_flush(void *_data)
+{
+	struct framework_data *data = _data;
+
+	// A failed write queues a sync, so the write has to go first
+	flush_delayed_work(&data->kb_led_work);
+	cancel_work_sync(&data->kb_led_sync_work);
+}
+
+
+// Wake up pollers of charge_control_end_threshold if the known limit moved
+// since they were last told
+static void fw_charge_limit_notify(struct framework_data *data)
+{
+	int limit = data->charge_limit;
+
+	lockdep_assert_held(&data->lock);
+
+	if (limit < 0 || limit == data->charge_limit_seen)
+		return;
+
+	// The first value read isn't a change
+	if (data->charge_limit_seen >= 0 && data->battery) {
+		sysfs_notify(&data->battery->dev.kobj, NULL,
+			     "charge_control_end_threshold");
+		power_supply_changed(data->battery);
+	}
+
+	data->charge_limit_seen = limit;
+}
+
+// Return the cached charge limit, only querying the EC when it is unknown
+static int fw_charge_limit(struct framework_data *data)
+{
+	lockdep_assert_held(&data->lock);
+
+	if (data->charge_limit < 0)
+		data->charge_limit =
+			charge_limit_control(data, CHG_LIMIT_GET_LIMIT, 0);
+
+	return data->charge_limit;
+}
+
+static int framework_get_charge_limit(struct framework_data *data)
+{
+	int ret;
+
+	mutex_lock(&data->lock);
+	ret = fw_charge_limit(data);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static int fw_set_charge_limit(struct framework_data *data, u8 value)
+{
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	ret = charge_limit_control(data, CHG_LIMIT_SET_LIMIT, value);
+	// Write-through, or force a re-query if the EC rejected it
+	data->charge_limit = ret < 0 ? -ENODATA : value;
+	fw_charge_limit_notify(data);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int framework_set_charge_limit(struct framework_data *data, u8 value)
+{
+	int ret;
 
-static ssize_t battery_get_threshold(char *buf)
+	mutex_lock(&data->lock);
+	ret = fw_set_charge_limit(data, value);
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+// Drop everything cached from the EC, it will be re-read on next use
+static void framework_invalidate_cache(struct framework_data *data)
+{
+	mutex_lock(&data->lock);
+	data->charge_limit = -ENODATA;
+	mutex_unlock(&data->lock);
+}
+
+static ssize_t battery_get_threshold(struct framework_data *data, char *buf)
 {
 	int ret;
 
-	ret = charge_limit_control(CHG_LIMIT_GET_LIMIT, 0);
+	ret = framework_get_charge_limit(data);
 	if (ret < 0)
 		return ret;
 
 	return sysfs_emit(buf, "%d\n", (int)ret);
 }
 
-static ssize_t battery_set_threshold(const char *buf, size_t count)
+static ssize_t battery_set_threshold(struct framework_data *data,
+				     const char *buf, size_t count)
 {
 	int ret;
 	int value;
@@ -211,7 +861,7 @@ static ssize_t battery_set_threshold(const char *buf, size_t count)
 	if (value > 100)
 		return -EINVAL;
 
-	ret = charge_limit_control(CHG_LIMIT_SET_LIMIT, (uint8_t)value);
+	ret = framework_set_charge_limit(data, (uint8_t)value);
 	if (ret < 0)
 		return ret;
 
@@ -221,23 +871,44 @@ static ssize_t battery_set_threshold(const char *buf, size_t count)
 static ssize_t charge_control_end_threshold_show(struct device *dev,
 	struct device_attribute *attr, char *buf)
 {
-	return battery_get_threshold(buf);
+	struct framework_data *data =
+		container_of(attr, struct framework_data, charge_attr);
+
+	return battery_get_threshold(data, buf);
 }
 
 static ssize_t charge_control_end_threshold_store(struct device *dev,
 	struct device_attribute *attr, const char *buf, size_t count)
 {
-	return battery_set_threshold(buf, count);
-}
+	struct framework_data *data =
+		container_of(attr, struct framework_data, charge_attr);
 
-static DEVICE_ATTR_RW(charge_control_end_threshold);
+	return battery_set_threshold(data, buf, count);
+}
 
-static struct attribute *framework_laptop_battery_attrs[] = {
-	&dev_attr_charge_control_end_threshold.attr,
-	NULL,
-};
+// The attribute lives in framework_data so that its callbacks can find
+// their instance from the battery device
+static void framework_battery_attrs_init(struct framework_data *data)
+{
+	sysfs_attr_init(&data->charge_attr.attr);
+	data->charge_attr.attr.name = "charge_control_end_threshold";
+	data->charge_attr.attr.mode = 0644;
+	data->charge_attr.show = charge_control_end_threshold_show;
+	data->charge_attr.store = charge_control_end_threshold_store;
+
+	data->battery_attrs[0] = &data->charge_attr.attr;
+	data->battery_group.attrs = data->battery_attrs;
+	data->battery_groups[0] = &data->battery_group;
+}
 
-ATTRIBUTE_GROUPS(framework_laptop_battery);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+#define framework_battery_hook_data(hook) \
+	container_of(hook, struct framework_data, battery_hook)
+#else
+// Older kernels don't pass the hook, so fall back to the only instance
+#define framework_battery_hook_data(hook) \
+	((struct framework_data *)platform_get_drvdata(fwdevice))
+#endif
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
 static int framework_laptop_battery_add(struct power_supply *battery, struct acpi_battery_hook *hook)
@@ -245,13 +916,19 @@ static int framework_laptop_battery_add(struct power_supply *battery, struct acp
 static int framework_laptop_battery_add(struct power_supply *battery)
 #endif
 {
+	struct framework_data *data = framework_battery_hook_data(hook);
+
 	// Framework EC only supports 1 battery
 	if (strcmp(battery->desc->name, "BAT1") != 0)
 		return -ENODEV;
 
-	if (device_add_groups(&battery->dev, framework_laptop_battery_groups))
+	if (!data || device_add_groups(&battery->dev, data->battery_groups))
 		return -ENODEV;
 
+	mutex_lock(&data->lock);
+	data->battery = battery;
+	mutex_unlock(&data->lock);
+
 	return 0;
 }
 
@@ -261,403 +938,2552 @@ static int framework_laptop_battery_remove(struct power_supply *battery, struct
 static int framework_laptop_battery_remove(struct power_supply *battery)
 #endif
 {
-	device_remove_groups(&battery->dev, framework_laptop_battery_groups);
+	struct framework_data *data = framework_battery_hook_data(hook);
+
+	if (data) {
+		mutex_lock(&data->lock);
+		if (data->battery == battery)
+			data->battery = NULL;
+		mutex_unlock(&data->lock);
+
+		device_remove_groups(&battery->dev, data->battery_groups);
+	}
+	return 0;
+}
+
+// --- EC memmap snapshot ---
+// Read the temperature and fan blocks from the EC's memory, unless the
+// cached copy is still within memmap_cache_ms
+static int ec_read_memmap_snapshot(struct framework_data *data,
+				   struct fw_memmap_snapshot *snap)
+{
+	struct fw_memmap_cache *cache = &data->memmap;
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	if (cache->valid &&
+	    time_before(jiffies, cache->timestamp +
+					 msecs_to_jiffies(memmap_cache_ms))) {
+		cache->hits++;
+	} else {
+		cache->reads++;
+		ret = fw_ec_readmem(data, EC_MEMMAP_TEMP_SENSOR,
+				    sizeof(cache->snap), &cache->snap);
+		if (ret < 0) {
+			cache->valid = false;
+			return ret;
+		}
+		cache->timestamp = jiffies;
+		cache->valid = true;
+	}
+
+	*snap = cache->snap;
+
 	return 0;
 }
 
-// --- fanN_input ---
-// Read the current fan speed from the EC's memory
-static ssize_t ec_get_fan_speed(u8 idx, u16 *val)
+// --- fanN_target ---
+static ssize_t ec_set_target_rpm(struct framework_data *data, u8 idx, u32 *val)
+{
+	int ret;
+
+	if (fw_has(data, FW_CAP_FAN_TARGET_SET_V1)) {
+		struct ec_params_pwm_set_fan_target_rpm_v1 params = {
+			.rpm = *val,
+			.fan_idx = idx,
+		};
+
+		ret = fw_ec_cmd(data, 1, EC_CMD_PWM_SET_FAN_TARGET_RPM,
+				&params, sizeof(params), NULL, 0);
+	} else {
+		struct ec_params_pwm_set_fan_target_rpm_v0 params = {
+			.rpm = *val,
+		};
+
+		ret = fw_ec_cmd(data, 0, EC_CMD_PWM_SET_FAN_TARGET_RPM,
+				&params, sizeof(params), NULL, 0);
+	}
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+static ssize_t ec_get_target_rpm(struct framework_data *data, u8 idx, u32 *val)
+{
+	int ret;
+
+	struct ec_response_pwm_get_fan_rpm resp;
+
+	// index isn't supported, it should only return fan 0's target
+
+	ret = fw_ec_cmd(data, 0, EC_CMD_PWM_GET_FAN_TARGET_RPM, NULL, 0, &resp,
+			sizeof(resp));
+	if (ret < 0)
+		return -EIO;
+
+	*val = resp.rpm;
+
+	return 0;
+}
+
+// --- pwmN_enable ---
+static ssize_t ec_set_auto_fan_ctrl(struct framework_data *data, u8 idx)
+{
+	int ret;
+
+	if (fw_has(data, FW_CAP_FAN_AUTO_V1)) {
+		struct ec_params_auto_fan_ctrl_v1 params = {
+			.fan_idx = idx,
+		};
+
+		ret = fw_ec_cmd(data, 1, EC_CMD_THERMAL_AUTO_FAN_CTRL, &params,
+				sizeof(params), NULL, 0);
+	} else {
+		ret = fw_ec_cmd(data, 0, EC_CMD_THERMAL_AUTO_FAN_CTRL, NULL, 0,
+				NULL, 0);
+	}
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+// --- pwmN ---
+static ssize_t ec_set_fan_duty(struct framework_data *data, u8 idx, u32 *val)
+{
+	int ret;
+
+	if (fw_has(data, FW_CAP_FAN_DUTY_V1)) {
+		struct ec_params_pwm_set_fan_duty_v1 params = {
+			.percent = *val,
+			.fan_idx = idx,
+		};
+
+		ret = fw_ec_cmd(data, 1, EC_CMD_PWM_SET_FAN_DUTY, &params,
+				sizeof(params), NULL, 0);
+	} else {
+		struct ec_params_pwm_set_fan_duty_v0 params = {
+			.percent = *val,
+		};
+
+		ret = fw_ec_cmd(data, 0, EC_CMD_PWM_SET_FAN_DUTY, &params,
+				sizeof(params), NULL, 0);
+	}
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+static ssize_t ec_count_fans(struct framework_data *data, size_t *val)
+{
+	struct fw_memmap_snapshot snap;
+
+	int ret = ec_read_memmap_snapshot(data, &snap);
+	if (ret < 0)
+		return -EIO;
+
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++) {
+		if (snap.fans[i] == EC_FAN_SPEED_NOT_PRESENT) {
+			*val = i;
+			return 0;
+		}
+	}
+
+	*val = EC_FAN_SPEED_ENTRIES;
+	return 0;
+}
+
+// --- fan shadow registers ---
+// Every fan write goes through these. A duty cycle and a target RPM override
+// each other, and automatic control overrides both.
+static int fw_fan_set_duty(struct framework_data *data, u8 idx, u32 duty)
+{
+	struct fw_fan_shadow *shadow = &data->shadows[idx];
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	if (!fan_force_write && shadow->duty_valid && shadow->duty == duty) {
+		shadow->duty_suppressed++;
+		return 0;
+	}
+
+	ret = ec_set_fan_duty(data, idx, &duty);
+
+	shadow->duty_valid = !ret;
+	shadow->duty = duty;
+	shadow->target_valid = false;
+
+	return ret;
+}
+
+static int fw_fan_set_target(struct framework_data *data, u8 idx, u32 rpm)
+{
+	struct fw_fan_shadow *shadow = &data->shadows[idx];
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	if (!fan_force_write && shadow->target_valid && shadow->target == rpm) {
+		shadow->target_suppressed++;
+		return 0;
+	}
+
+	ret = ec_set_target_rpm(data, idx, &rpm);
+
+	shadow->target_valid = !ret;
+	shadow->target = rpm;
+	shadow->duty_valid = false;
+
+	return ret;
+}
+
+static int fw_fan_set_auto(struct framework_data *data, u8 idx)
+{
+	lockdep_assert_held(&data->lock);
+
+	data->shadows[idx].duty_valid = false;
+	data->shadows[idx].target_valid = false;
+
+	return ec_set_auto_fan_ctrl(data, idx);
+}
+
+// Valid shadows mean the EC is already running the fan with them, otherwise
+// start out at full speed until told otherwise
+static int fw_fan_set_manual(struct framework_data *data, u8 idx)
+{
+	struct fw_fan_shadow *shadow = &data->shadows[idx];
+
+	lockdep_assert_held(&data->lock);
+
+	if (shadow->duty_valid || shadow->target_valid)
+		return 0;
+
+	return fw_fan_set_duty(data, idx, 100);
+}
+
+// The EC may have reset the fans while we were asleep, write the manual
+// settings back. Curves are taken care of by their own work.
+static void fw_fan_restore(struct framework_data *data)
+{
+	mutex_lock(&data->lock);
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		struct fw_fan_shadow *shadow = &data->shadows[i];
+		bool duty_valid = shadow->duty_valid;
+		bool target_valid = shadow->target_valid;
+
+		shadow->duty_valid = false;
+		shadow->target_valid = false;
+
+		if (shadow->mode != FW_PWM_ENABLE_FULL &&
+		    shadow->mode != FW_PWM_ENABLE_MANUAL &&
+		    shadow->mode != FW_PWM_ENABLE_THERMAL)
+			continue;
+
+		if (duty_valid)
+			fw_fan_set_duty(data, i, shadow->duty);
+		else if (target_valid)
+			fw_fan_set_target(data, i, shadow->target);
+	}
+
+	mutex_unlock(&data->lock);
+}
+
+// --- tempN ---
+static bool ec_temp_is_error(u8 temp)
+{
+	return temp == EC_TEMP_SENSOR_NOT_PRESENT ||
+	       temp == EC_TEMP_SENSOR_ERROR ||
+	       temp == EC_TEMP_SENSOR_NOT_POWERED ||
+	       temp == EC_TEMP_SENSOR_NOT_CALIBRATED;
+}
+
+static int ec_get_temp_sensor_name(struct framework_data *data, u8 idx,
+				   struct ec_response_temp_sensor_get_info *resp)
+{
+	int ret;
+
+	struct ec_params_temp_sensor_get_info params = {
+		.id = idx,
+	};
+
+	ret = fw_ec_cmd(data, 0, EC_CMD_TEMP_SENSOR_GET_INFO, &params,
+			sizeof(params), resp, sizeof(*resp));
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+// Record which sensors are present and fetch their names. A sensor without
+// a name is still exposed, just without a label.
+static int framework_temp_init(struct framework_data *data)
+{
+	struct ec_response_temp_sensor_get_info info;
+	struct fw_memmap_snapshot snap;
+	int ret;
+
+	lockdep_assert_held(&data->lock);
+
+	ret = ec_read_memmap_snapshot(data, &snap);
+	if (ret < 0)
+		return -EIO;
+
+	for (size_t i = 0; i < EC_TEMP_SENSOR_ENTRIES; i++) {
+		if (snap.temps[i] == EC_TEMP_SENSOR_NOT_PRESENT)
+			continue;
+
+		__set_bit(i, &data->temp_present);
+
+		if (!fw_has(data, FW_CAP_TEMP_INFO) ||
+		    ec_get_temp_sensor_name(data, i, &info) < 0)
+			continue;
+
+		data->temp_labels[i] = devm_kstrndup(&data->pdev->dev,
+						     info.sensor_name,
+						     sizeof(info.sensor_name),
+						     GFP_KERNEL);
+	}
+
+	return 0;
+}
+
+// --- framework_privacy ---
+static int ec_get_privacy_switches(struct framework_data *data,
+				   struct ec_response_privacy_switches_check *resp)
+{
+	int ret;
+
+	ret = fw_ec_cmd(data, 0, EC_CMD_PRIVACY_SWITCHES_CHECK_MODE, NULL, 0,
+			resp, sizeof(*resp));
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+// Query the switches and cache the result
+static int framework_privacy_refresh(struct framework_data *data,
+				     struct ec_response_privacy_switches_check *resp)
+{
+	bool changed = false;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	ret = ec_get_privacy_switches(data, resp);
+	if (!ret) {
+		changed = data->privacy_valid &&
+			  (data->privacy.microphone != resp->microphone ||
+			   data->privacy.camera != resp->camera);
+		data->privacy = *resp;
+		data->privacy_valid = true;
+	}
+
+	mutex_unlock(&data->lock);
+
+	// Wake up pollers of framework_privacy, and let udev know
+	if (changed) {
+		sysfs_notify(&data->pdev->dev.kobj, NULL, "framework_privacy");
+		kobject_uevent(&data->pdev->dev.kobj, KOBJ_CHANGE);
+	}
+
+	return ret;
+}
+
+// Forward the switch state to the input device
+static void framework_privacy_report(struct framework_data *data,
+				     const struct ec_response_privacy_switches_check *resp)
+{
+	// The EC reports 1 when the device is enabled, the switches are the
+	// opposite. The input core drops reports that don't change anything.
+	input_report_switch(data->privacy_input, SW_MUTE_DEVICE,
+			    !resp->microphone);
+	input_report_switch(data->privacy_input, SW_CAMERA_LENS_COVER,
+			    !resp->camera);
+	input_sync(data->privacy_input);
+}
+
+static void framework_privacy_work_fn(struct work_struct *work)
+{
+	struct framework_data *data =
+		container_of(to_delayed_work(work), struct framework_data,
+			     privacy_work);
+	struct ec_response_privacy_switches_check resp;
+
+	if (!framework_privacy_refresh(data, &resp))
+		framework_privacy_report(data, &resp);
+
+	// Without EC events, fall back to polling at a low rate
+	if (data->privacy_poll && privacy_poll_ms)
+		schedule_delayed_work(&data->privacy_work,
+				      msecs_to_jiffies(privacy_poll_ms));
+}
+
+static void framework_privacy_stop(void *_data)
+{
+	struct framework_data *data = _data;
+
+	data->privacy_poll = false;
+	cancel_delayed_work_sync(&data->privacy_work);
+}
+
+static int framework_privacy_init(struct framework_data *data)
+{
+	struct device *dev = &data->pdev->dev;
+	struct input_dev *input;
+	int ret;
+
+	INIT_DELAYED_WORK(&data->privacy_work, framework_privacy_work_fn);
+	data->privacy_poll = !data->ec->mkbp_event_supported;
+
+	input = devm_input_allocate_device(dev);
+	if (!input)
+		return -ENOMEM;
+
+	input->name = "Framework Laptop Privacy Switches";
+	input->phys = DRV_NAME "/input0";
+	input->id.bustype = BUS_HOST;
+	input_set_capability(input, EV_SW, SW_MUTE_DEVICE);
+	input_set_capability(input, EV_SW, SW_CAMERA_LENS_COVER);
+
+	ret = input_register_device(input);
+	if (ret)
+		return ret;
+
+	data->privacy_input = input;
+
+	// Runs before the input device is unregistered
+	ret = devm_add_action_or_reset(dev, framework_privacy_stop, data);
+	if (ret)
+		return ret;
+
+	// Report the initial state
+	schedule_delayed_work(&data->privacy_work, 0);
+
+	return 0;
+}
+
+static ssize_t framework_privacy_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	struct ec_response_privacy_switches_check resp;
+	bool valid;
+	int ret;
+
+	mutex_lock(&data->lock);
+	resp = data->privacy;
+	valid = data->privacy_valid;
+	mutex_unlock(&data->lock);
+
+	// Only hit the EC if no event or poll has reported the state yet
+	if (!valid) {
+		ret = framework_privacy_refresh(data, &resp);
+		if (ret < 0)
+			return ret;
+
+		framework_privacy_report(data, &resp);
+	}
+
+	// Output following dell-privacy's format
+	return sysfs_emit(buf, "[Microphone] [%s]\n[Camera] [%s]\n",
+			  resp.microphone ? "unmuted" : "muted",
+			  resp.camera ? "unmuted" : "muted");
+}
+
+// --- fan curves ---
+// Nothing written yet, or the fan was handed back to the EC
+#define FW_CURVE_DUTY_UNSET -1
+#define FW_CURVE_DUTY_EC -2
+
+static const struct fw_curve_point fw_default_curve[FW_CURVE_POINTS] = {
+	{ 40000, 0 }, { 50000, 20 }, { 60000, 40 }, { 70000, 70 }, { 80000, 100 },
+};
+
+// Piecewise-linear interpolation, flat beyond the first and last points
+static int fw_fan_curve_eval(const struct fw_fan_curve *curve, int temp)
+{
+	const struct fw_curve_point *p = curve->points;
+
+	if (temp <= p[0].temp)
+		return p[0].pwm;
+
+	for (size_t i = 1; i < FW_CURVE_POINTS; i++) {
+		if (temp < p[i].temp)
+			return p[i - 1].pwm + (temp - p[i - 1].temp) *
+						      (p[i].pwm - p[i - 1].pwm) /
+						      (p[i].temp - p[i - 1].temp);
+	}
+
+	return p[FW_CURVE_POINTS - 1].pwm;
+}
+
+// Hottest of the sensors driving the fan
+static int fw_fan_curve_temp(struct framework_data *data,
+			     const struct fw_fan_curve *curve,
+			     const struct fw_memmap_snapshot *snap, int *temp)
+{
+	unsigned long channels = curve->channels ?: data->temp_present;
+	bool found = false;
+	unsigned int i;
+
+	for_each_set_bit(i, &channels, EC_TEMP_SENSOR_ENTRIES) {
+		int t;
+
+		if (ec_temp_is_error(snap->temps[i]))
+			continue;
+
+		t = kelvin_to_millicelsius(snap->temps[i] + EC_TEMP_SENSOR_OFFSET);
+		if (!found || t > *temp)
+			*temp = t;
+		found = true;
+	}
+
+	return found ? 0 : -ENODATA;
+}
+
+static void fw_fan_curve_apply(struct framework_data *data, u8 idx,
+			       const struct fw_memmap_snapshot *snap)
+{
+	struct fw_fan_curve *curve = &data->curves[idx];
+	int temp, duty;
+	u32 val;
+
+	lockdep_assert_held(&data->lock);
+
+	if (fw_fan_curve_temp(data, curve, snap, &temp) < 0) {
+		// No usable sensor, let the EC look after the fan
+		if (curve->duty != FW_CURVE_DUTY_EC &&
+		    !fw_fan_set_auto(data, idx))
+			curve->duty = FW_CURVE_DUTY_EC;
+		return;
+	}
+
+	duty = fw_fan_curve_eval(curve, temp);
+
+	// Ignore changes within the hysteresis band, but always let the fan
+	// reach either end of the curve
+	if (curve->duty >= 0) {
+		if (duty == curve->duty)
+			return;
+
+		if (abs(duty - curve->duty) <= fan_curve_hysteresis &&
+		    duty != curve->points[0].pwm &&
+		    duty != curve->points[FW_CURVE_POINTS - 1].pwm)
+			return;
+	}
+
+	val = duty;
+	if (!fw_fan_set_duty(data, idx, val))
+		curve->duty = duty;
+}
+
+static void fw_fan_curve_work_fn(struct work_struct *work)
+{
+	struct framework_data *data = container_of(
+		to_delayed_work(work), struct framework_data, curve_work);
+	struct fw_memmap_snapshot snap;
+	bool active = false;
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	ret = ec_read_memmap_snapshot(data, &snap);
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		if (data->shadows[i].mode != FW_PWM_ENABLE_CURVE)
+			continue;
+
+		active = true;
+		if (!ret)
+			fw_fan_curve_apply(data, i, &snap);
+	}
+
+	mutex_unlock(&data->lock);
+
+	// Stops by itself once no fan uses a curve anymore
+	if (active)
+		schedule_delayed_work(&data->curve_work,
+				      msecs_to_jiffies(max(fan_curve_interval_ms, 100U)));
+}
+
+static void fw_fan_curve_start(struct framework_data *data, u8 idx)
+{
+	lockdep_assert_held(&data->lock);
+
+	data->shadows[idx].mode = FW_PWM_ENABLE_CURVE;
+	data->curves[idx].duty = FW_CURVE_DUTY_UNSET;
+	mod_delayed_work(system_wq, &data->curve_work, 0);
+}
+
+// Force every active curve to be written to the EC again
+static void fw_fan_curve_resync(struct framework_data *data)
+{
+	bool active = false;
+
+	mutex_lock(&data->lock);
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		if (data->shadows[i].mode != FW_PWM_ENABLE_CURVE)
+			continue;
+
+		data->curves[i].duty = FW_CURVE_DUTY_UNSET;
+		active = true;
+	}
+
+	mutex_unlock(&data->lock);
+
+	if (active)
+		mod_delayed_work(system_wq, &data->curve_work, 0);
+}
+
+static void framework_fan_curve_cancel(void *_data)
+{
+	struct framework_data *data = _data;
+
+	cancel_delayed_work_sync(&data->curve_work);
+}
+
+static int framework_fan_curve_init(struct framework_data *data)
+{
+	INIT_DELAYED_WORK(&data->curve_work, fw_fan_curve_work_fn);
+
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++) {
+		// The EC starts out in control of the fans
+		data->shadows[i].mode = FW_PWM_ENABLE_AUTO;
+		memcpy(data->curves[i].points, fw_default_curve,
+		       sizeof(fw_default_curve));
+		data->curves[i].duty = FW_CURVE_DUTY_UNSET;
+	}
+
+	return devm_add_action_or_reset(&data->pdev->dev,
+					framework_fan_curve_cancel, data);
+}
+
+// --- hwmon ---
+static int fw_hwmon_read_fan(struct framework_data *data, u32 attr,
+			     int channel, long *val)
+{
+	struct fw_memmap_snapshot snap;
+	u16 fan;
+	u32 target;
+
+	if (attr == hwmon_fan_target) {
+		// A target we set is still in effect until overridden
+		if (data->shadows[channel].target_valid) {
+			*val = data->shadows[channel].target;
+			return 0;
+		}
+
+		// Otherwise only fan 0's target can be queried
+		if (channel != 0 || !fw_has(data, FW_CAP_FAN_TARGET_GET))
+			return -ENODATA;
+
+		if (ec_get_target_rpm(data, channel, &target) < 0)
+			return -EIO;
+
+		*val = target;
+		return 0;
+	}
+
+	// Every other fan attribute is served from the same snapshot
+	if (ec_read_memmap_snapshot(data, &snap) < 0)
+		return -EIO;
+
+	fan = snap.fans[channel];
+
+	switch (attr) {
+	case hwmon_fan_input:
+		if (fan == EC_FAN_SPEED_NOT_PRESENT ||
+		    fan == EC_FAN_SPEED_STALLED)
+			*val = 0;
+		else
+			*val = fan;
+		return 0;
+	case hwmon_fan_fault:
+		if (data->fan_monitor_valid)
+			*val = data->monitors[channel].fault;
+		else
+			*val = fan == EC_FAN_SPEED_NOT_PRESENT;
+		return 0;
+	case hwmon_fan_alarm:
+		if (data->fan_monitor_valid) {
+			struct fw_fan_monitor *mon = &data->monitors[channel];
+
+			// Reading acknowledges a stall that is over
+			*val = mon->alarm;
+			if (!mon->stalled)
+				mon->alarm = false;
+		} else {
+			*val = fan == EC_FAN_SPEED_STALLED;
+		}
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int fw_hwmon_read_temp(struct framework_data *data, u32 attr,
+			      int channel, long *val)
+{
+	struct fw_memmap_snapshot snap;
+	u8 temp;
+
+	if (ec_read_memmap_snapshot(data, &snap) < 0)
+		return -EIO;
+
+	temp = snap.temps[channel];
+
+	switch (attr) {
+	case hwmon_temp_input:
+		if (ec_temp_is_error(temp))
+			return -ENODATA;
+
+		*val = kelvin_to_millicelsius(temp + EC_TEMP_SENSOR_OFFSET);
+		return 0;
+	case hwmon_temp_fault:
+		*val = ec_temp_is_error(temp);
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int fw_hwmon_read_pwm(struct framework_data *data, u32 attr,
+			     int channel, long *val)
+{
+	switch (attr) {
+	case hwmon_pwm_enable:
+		*val = data->shadows[channel].mode;
+		return 0;
+	case hwmon_pwm_input:
+		// The EC can't report the duty cycle, only what we last set is
+		// known
+		if (!data->shadows[channel].duty_valid)
+			return -ENODATA;
+
+		*val = data->shadows[channel].duty;
+		return 0;
+	case hwmon_pwm_auto_channels_temp:
+		*val = data->curves[channel].channels ?: data->temp_present;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int fw_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
+			 u32 attr, int channel, long *val)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	mutex_lock(&data->lock);
+
+	switch (type) {
+	case hwmon_fan:
+		ret = fw_hwmon_read_fan(data, attr, channel, val);
+		break;
+	case hwmon_temp:
+		ret = fw_hwmon_read_temp(data, attr, channel, val);
+		break;
+	case hwmon_pwm:
+		ret = fw_hwmon_read_pwm(data, attr, channel, val);
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static int fw_hwmon_read_string(struct device *dev,
+				enum hwmon_sensor_types type, u32 attr,
+				int channel, const char **str)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+
+	if (type != hwmon_temp || attr != hwmon_temp_label)
+		return -EOPNOTSUPP;
+
+	// Labels are fetched once at probe time
+	*str = data->temp_labels[channel];
+
+	return 0;
+}
+
+static int fw_hwmon_write_fan(struct framework_data *data, u32 attr,
+			      int channel, u32 val)
+{
+	switch (attr) {
+	case hwmon_fan_target:
+		if (fw_fan_set_target(data, channel, val) < 0)
+			return -EIO;
+
+		// Any other way of controlling the fan takes it off the curve
+		data->shadows[channel].mode = FW_PWM_ENABLE_MANUAL;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int fw_hwmon_write_pwm(struct framework_data *data, u32 attr,
+			      int channel, u32 val)
+{
+	int ret;
+
+	switch (attr) {
+	case hwmon_pwm_enable:
+		switch (val) {
+		case FW_PWM_ENABLE_FULL:
+			ret = fw_fan_set_duty(data, channel, 100);
+			break;
+		case FW_PWM_ENABLE_MANUAL:
+			ret = fw_fan_set_manual(data, channel);
+			break;
+		case FW_PWM_ENABLE_AUTO:
+			ret = fw_fan_set_auto(data, channel);
+			break;
+		case FW_PWM_ENABLE_CURVE:
+			fw_fan_curve_start(data, channel);
+			return 0;
+		default:
+			return -EINVAL;
+		}
+
+		if (ret < 0)
+			return -EIO;
+
+		data->shadows[channel].mode = val;
+		return 0;
+	case hwmon_pwm_input:
+		// A percentage, as pwmN_max reports
+		if (val > 100)
+			return -EINVAL;
+
+		if (fw_fan_set_duty(data, channel, val) < 0)
+			return -EIO;
+
+		data->shadows[channel].mode = FW_PWM_ENABLE_MANUAL;
+		return 0;
+	case hwmon_pwm_auto_channels_temp:
+		if (!val || (val & ~data->temp_present))
+			return -EINVAL;
+
+		data->curves[channel].channels = val;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int fw_hwmon_write(struct device *dev, enum hwmon_sensor_types type,
+			  u32 attr, int channel, long val)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	int ret;
+
+	if (val < 0 || val > U32_MAX)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+
+	switch (type) {
+	case hwmon_fan:
+		ret = fw_hwmon_write_fan(data, attr, channel, val);
+		break;
+	case hwmon_pwm:
+		ret = fw_hwmon_write_pwm(data, attr, channel, val);
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static umode_t fw_hwmon_is_visible(const void *drvdata,
+				   enum hwmon_sensor_types type, u32 attr,
+				   int channel)
+{
+	const struct framework_data *data = drvdata;
+
+	switch (type) {
+	case hwmon_fan:
+		if (channel >= data->fan_count)
+			return 0;
+
+		switch (attr) {
+		case hwmon_fan_input:
+		case hwmon_fan_fault:
+		case hwmon_fan_alarm:
+			return 0444;
+		case hwmon_fan_target:
+			if (fw_has_fan_cmd(data, FW_CAP_FAN_TARGET_SET_V0,
+					   FW_CAP_FAN_TARGET_SET_V1))
+				return 0644;
+
+			return channel == 0 &&
+				       fw_has(data, FW_CAP_FAN_TARGET_GET) ?
+				       0444 : 0;
+		default:
+			return 0;
+		}
+	case hwmon_pwm:
+		if (channel >= data->fan_count ||
+		    !fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0, FW_CAP_FAN_DUTY_V1))
+			return 0;
+
+		switch (attr) {
+		case hwmon_pwm_input:
+		case hwmon_pwm_auto_channels_temp:
+			return 0644;
+		case hwmon_pwm_enable:
+			if (!fw_has_fan_cmd(data, FW_CAP_FAN_AUTO_V0,
+					    FW_CAP_FAN_AUTO_V1))
+				return 0;
+
+			return 0644;
+		default:
+			return 0;
+		}
+	case hwmon_temp:
+		if (!test_bit(channel, &data->temp_present))
+			return 0;
+
+		switch (attr) {
+		case hwmon_temp_input:
+		case hwmon_temp_fault:
+			return 0444;
+		case hwmon_temp_label:
+			return data->temp_labels[channel] ? 0444 : 0;
+		default:
+			return 0;
+		}
+	default:
+		return 0;
+	}
+}
+
+static const struct hwmon_ops fw_hwmon_ops = {
+	.is_visible = fw_hwmon_is_visible,
+	.read = fw_hwmon_read,
+	.read_string = fw_hwmon_read_string,
+	.write = fw_hwmon_write,
+};
+
+// clang-format off
+static const struct hwmon_channel_info *fw_hwmon_info[] = {
+	HWMON_CHANNEL_INFO(fan,
+			   HWMON_F_INPUT | HWMON_F_TARGET | HWMON_F_FAULT | HWMON_F_ALARM,
+			   HWMON_F_INPUT | HWMON_F_TARGET | HWMON_F_FAULT | HWMON_F_ALARM,
+			   HWMON_F_INPUT | HWMON_F_TARGET | HWMON_F_FAULT | HWMON_F_ALARM,
+			   HWMON_F_INPUT | HWMON_F_TARGET | HWMON_F_FAULT | HWMON_F_ALARM),
+	HWMON_CHANNEL_INFO(pwm,
+			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE | HWMON_PWM_AUTO_CHANNELS_TEMP,
+			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE | HWMON_PWM_AUTO_CHANNELS_TEMP,
+			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE | HWMON_PWM_AUTO_CHANNELS_TEMP,
+			   HWMON_PWM_INPUT | HWMON_PWM_ENABLE | HWMON_PWM_AUTO_CHANNELS_TEMP),
+	HWMON_CHANNEL_INFO(temp,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_FAULT | HWMON_T_LABEL),
+	NULL
+};
+// clang-format on
+
+static const struct hwmon_chip_info fw_hwmon_chip_info = {
+	.ops = &fw_hwmon_ops,
+	.info = fw_hwmon_info,
+};
+
+// --- pwmN_min / pwmN_max ---
+// These have no hwmon core equivalent, so they stay as extra attributes
+static ssize_t fw_pwm_min_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%i\n", 0);
+}
+
+static ssize_t fw_pwm_max_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%i\n", 100);
+}
+
+static SENSOR_DEVICE_ATTR_RO(pwm1_min, fw_pwm_min, 0);
+static SENSOR_DEVICE_ATTR_RO(pwm1_max, fw_pwm_max, 0);
+static SENSOR_DEVICE_ATTR_RO(pwm2_min, fw_pwm_min, 1);
+static SENSOR_DEVICE_ATTR_RO(pwm2_max, fw_pwm_max, 1);
+static SENSOR_DEVICE_ATTR_RO(pwm3_min, fw_pwm_min, 2);
+static SENSOR_DEVICE_ATTR_RO(pwm3_max, fw_pwm_max, 2);
+static SENSOR_DEVICE_ATTR_RO(pwm4_min, fw_pwm_min, 3);
+static SENSOR_DEVICE_ATTR_RO(pwm4_max, fw_pwm_max, 3);
+
+static struct attribute *fw_hwmon_attrs[] = {
+	&sensor_dev_attr_pwm1_min.dev_attr.attr,
+	&sensor_dev_attr_pwm1_max.dev_attr.attr,
+	&sensor_dev_attr_pwm2_min.dev_attr.attr,
+	&sensor_dev_attr_pwm2_max.dev_attr.attr,
+	&sensor_dev_attr_pwm3_min.dev_attr.attr,
+	&sensor_dev_attr_pwm3_max.dev_attr.attr,
+	&sensor_dev_attr_pwm4_min.dev_attr.attr,
+	&sensor_dev_attr_pwm4_max.dev_attr.attr,
+	NULL,
+};
+
+static umode_t fw_hwmon_attr_is_visible(struct kobject *kobj,
+					struct attribute *attr, int n)
+{
+	struct framework_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(
+		container_of(attr, struct device_attribute, attr));
+
+	if (sen_attr->index >= data->fan_count ||
+	    !fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0, FW_CAP_FAN_DUTY_V1))
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group fw_hwmon_group = {
+	.attrs = fw_hwmon_attrs,
+	.is_visible = fw_hwmon_attr_is_visible,
+};
+
+// --- pwmN_auto_pointM_temp / pwmN_auto_pointM_pwm ---
+static ssize_t fw_auto_point_temp_show(struct device *dev,
+				       struct device_attribute *attr, char *buf)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	struct sensor_device_attribute_2 *sen_attr = to_sensor_dev_attr_2(attr);
+	int temp;
+
+	mutex_lock(&data->lock);
+	temp = data->curves[sen_attr->nr].points[sen_attr->index].temp;
+	mutex_unlock(&data->lock);
+
+	return sysfs_emit(buf, "%d\n", temp);
+}
+
+// Points must stay in ascending temperature order
+static ssize_t fw_auto_point_temp_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	struct sensor_device_attribute_2 *sen_attr = to_sensor_dev_attr_2(attr);
+	struct fw_curve_point *points = data->curves[sen_attr->nr].points;
+	int point = sen_attr->index;
+	int temp, ret;
+
+	ret = kstrtoint(buf, 10, &temp);
+	if (ret)
+		return ret;
+
+	if (temp < 0 || temp > 200000)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+
+	if ((point > 0 && temp < points[point - 1].temp) ||
+	    (point < FW_CURVE_POINTS - 1 && temp > points[point + 1].temp))
+		ret = -EINVAL;
+	else
+		points[point].temp = temp;
+
+	mutex_unlock(&data->lock);
+
+	return ret ?: count;
+}
+
+static ssize_t fw_auto_point_pwm_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	struct sensor_device_attribute_2 *sen_attr = to_sensor_dev_attr_2(attr);
+	u8 pwm;
+
+	mutex_lock(&data->lock);
+	pwm = data->curves[sen_attr->nr].points[sen_attr->index].pwm;
+	mutex_unlock(&data->lock);
+
+	return sysfs_emit(buf, "%u\n", pwm);
+}
+
+static ssize_t fw_auto_point_pwm_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+	struct sensor_device_attribute_2 *sen_attr = to_sensor_dev_attr_2(attr);
+	unsigned int pwm;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &pwm);
+	if (ret)
+		return ret;
+
+	if (pwm > 100)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+	data->curves[sen_attr->nr].points[sen_attr->index].pwm = pwm;
+	mutex_unlock(&data->lock);
+
+	return count;
+}
+
+// clang-format off
+#define FW_CURVE_POINT_ATTRS(fan, point)					\
+	static SENSOR_DEVICE_ATTR_2_RW(pwm##fan##_auto_point##point##_temp,	\
+				       fw_auto_point_temp, fan - 1, point - 1);	\
+	static SENSOR_DEVICE_ATTR_2_RW(pwm##fan##_auto_point##point##_pwm,	\
+				       fw_auto_point_pwm, fan - 1, point - 1)
+
+#define FW_CURVE_ATTRS(fan)		\
+	FW_CURVE_POINT_ATTRS(fan, 1);	\
+	FW_CURVE_POINT_ATTRS(fan, 2);	\
+	FW_CURVE_POINT_ATTRS(fan, 3);	\
+	FW_CURVE_POINT_ATTRS(fan, 4);	\
+	FW_CURVE_POINT_ATTRS(fan, 5)
+
+#define FW_CURVE_POINT_ATTR_PTRS(fan, point)					\
+	&sensor_dev_attr_pwm##fan##_auto_point##point##_temp.dev_attr.attr,	\
+	&sensor_dev_attr_pwm##fan##_auto_point##point##_pwm.dev_attr.attr
+
+#define FW_CURVE_ATTR_PTRS(fan)			\
+	FW_CURVE_POINT_ATTR_PTRS(fan, 1),	\
+	FW_CURVE_POINT_ATTR_PTRS(fan, 2),	\
+	FW_CURVE_POINT_ATTR_PTRS(fan, 3),	\
+	FW_CURVE_POINT_ATTR_PTRS(fan, 4),	\
+	FW_CURVE_POINT_ATTR_PTRS(fan, 5)
+
+FW_CURVE_ATTRS(1);
+FW_CURVE_ATTRS(2);
+FW_CURVE_ATTRS(3);
+FW_CURVE_ATTRS(4);
+
+static struct attribute *fw_curve_attrs[] = {
+	FW_CURVE_ATTR_PTRS(1),
+	FW_CURVE_ATTR_PTRS(2),
+	FW_CURVE_ATTR_PTRS(3),
+	FW_CURVE_ATTR_PTRS(4),
+	NULL,
+};
+// clang-format on
+
+static umode_t fw_curve_attr_is_visible(struct kobject *kobj,
+					struct attribute *attr, int n)
+{
+	struct framework_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+	struct sensor_device_attribute_2 *sen_attr = to_sensor_dev_attr_2(
+		container_of(attr, struct device_attribute, attr));
+
+	if (sen_attr->nr >= data->fan_count ||
+	    !fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0, FW_CAP_FAN_DUTY_V1))
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group fw_curve_group = {
+	.attrs = fw_curve_attrs,
+	.is_visible = fw_curve_attr_is_visible,
+};
+
+static const struct attribute_group *fw_hwmon_groups[] = {
+	&fw_hwmon_group,
+	&fw_curve_group,
+	NULL,
+};
+
+// --- thermal ---
+// Cooling state 0 hands the fan back to the EC's automatic control, states
+// 1 to FW_COOLING_STATES set the duty cycle in equal steps
+#define FW_COOLING_STATES 10
+
+static int fw_cooling_get_max_state(struct thermal_cooling_device *cdev,
+				    unsigned long *state)
+{
+	*state = FW_COOLING_STATES;
+	return 0;
+}
+
+static int fw_cooling_get_cur_state(struct thermal_cooling_device *cdev,
+				    unsigned long *state)
+{
+	struct fw_fan_cooling *cooling = cdev->devdata;
+	struct framework_data *data = cooling->data;
+
+	mutex_lock(&data->lock);
+	if (data->shadows[cooling->idx].mode == FW_PWM_ENABLE_THERMAL)
+		*state = cooling->state;
+	else
+		*state = 0;
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+static int fw_cooling_set_cur_state(struct thermal_cooling_device *cdev,
+				    unsigned long state)
+{
+	struct fw_fan_cooling *cooling = cdev->devdata;
+	struct framework_data *data = cooling->data;
+	struct fw_fan_shadow *shadow = &data->shadows[cooling->idx];
+	u32 duty;
+	int ret = 0;
+
+	if (state > FW_COOLING_STATES)
+		return -EINVAL;
+
+	mutex_lock(&data->lock);
+
+	// Only fans left to the EC or already driven from here, never manual
+	// settings or a fan curve
+	if (shadow->mode != FW_PWM_ENABLE_AUTO &&
+	    shadow->mode != FW_PWM_ENABLE_THERMAL) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (state) {
+		duty = state * 100 / FW_COOLING_STATES;
+		ret = fw_fan_set_duty(data, cooling->idx, duty);
+		if (!ret)
+			shadow->mode = FW_PWM_ENABLE_THERMAL;
+	} else if (shadow->mode == FW_PWM_ENABLE_THERMAL) {
+		ret = fw_fan_set_auto(data, cooling->idx);
+		if (!ret)
+			shadow->mode = FW_PWM_ENABLE_AUTO;
+	}
+
+	if (!ret)
+		cooling->state = state;
+
+out:
+	mutex_unlock(&data->lock);
+
+	return ret;
+}
+
+static const struct thermal_cooling_device_ops fw_cooling_ops = {
+	.get_max_state = fw_cooling_get_max_state,
+	.get_cur_state = fw_cooling_get_cur_state,
+	.set_cur_state = fw_cooling_set_cur_state,
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+static int ec_get_thermal_config(struct framework_data *data, u8 idx,
+				 struct ec_thermal_config *config)
+{
+	int ret;
+
+	struct ec_params_thermal_get_threshold_v1 params = {
+		.sensor_num = idx,
+	};
+
+	ret = fw_ec_cmd(data, 1, EC_CMD_THERMAL_GET_THRESHOLD, &params,
+			sizeof(params), config, sizeof(*config));
+	if (ret < 0)
+		return -EIO;
+
+	return 0;
+}
+
+static int fw_tz_get_temp(struct thermal_zone_device *tz, int *temp)
+{
+	struct fw_temp_zone *zone = thermal_zone_device_priv(tz);
+	struct framework_data *data = zone->data;
+	struct fw_memmap_snapshot snap;
+	int ret;
+
+	mutex_lock(&data->lock);
+	ret = ec_read_memmap_snapshot(data, &snap);
+	mutex_unlock(&data->lock);
+	if (ret < 0)
+		return -EIO;
+
+	if (ec_temp_is_error(snap.temps[zone->idx]))
+		return -ENODATA;
+
+	*temp = kelvin_to_millicelsius(snap.temps[zone->idx] +
+				       EC_TEMP_SENSOR_OFFSET);
+
+	return 0;
+}
+
+// With thermal_fan_control, every zone drives every fan and the governor
+// picks the highest demand
+static bool fw_tz_should_bind(struct thermal_zone_device *tz,
+			      const struct thermal_trip *trip,
+			      struct thermal_cooling_device *cdev,
+			      struct cooling_spec *c)
+{
+	struct fw_temp_zone *zone = thermal_zone_device_priv(tz);
+	struct framework_data *data = zone->data;
+
+	if (!thermal_fan_control)
+		return false;
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		if (cdev->devdata == &data->cooling[i])
+			return true;
+	}
+
+	return false;
+}
+
+static const struct thermal_zone_device_ops fw_tz_ops = {
+	.should_bind = fw_tz_should_bind,
+	.get_temp = fw_tz_get_temp,
+};
+
+static void fw_tz_unregister(void *tz)
+{
+	thermal_zone_device_unregister(tz);
+}
+
+static int framework_thermal_zone_init(struct framework_data *data, u8 idx)
+{
+	struct fw_temp_zone *zone = &data->zones[idx];
+	struct device *dev = &data->pdev->dev;
+	struct thermal_trip trip = {};
+	struct ec_thermal_config config;
+	struct thermal_zone_device *tz;
+	char name[THERMAL_NAME_LENGTH];
+	int num_trips = 0;
+	int ret;
+
+	zone->data = data;
+	zone->idx = idx;
+
+	if (thermal_fan_control && fw_has(data, FW_CAP_THERMAL_THRESHOLD)) {
+		mutex_lock(&data->lock);
+		ret = ec_get_thermal_config(data, idx, &config);
+		mutex_unlock(&data->lock);
+	} else {
+		ret = -EOPNOTSUPP;
+	}
+
+	// The fans start spinning at temp_fan_off under EC control, so that's
+	// where the governor takes over. Without it, or by default, the zone
+	// only reports the temperature and the EC keeps the fans.
+	if (!ret && config.temp_fan_off) {
+		trip.type = THERMAL_TRIP_ACTIVE;
+		trip.temperature = kelvin_to_millicelsius(config.temp_fan_off);
+		num_trips = 1;
+	}
+
+	snprintf(name, sizeof(name), "framework_tz%u", idx + 1);
+
+	tz = thermal_zone_device_register_with_trips(name, &trip, num_trips,
+						     zone, &fw_tz_ops, NULL, 0,
+						     num_trips ? thermal_poll_ms : 0);
+	if (IS_ERR(tz))
+		return PTR_ERR(tz);
+
+	ret = devm_add_action_or_reset(dev, fw_tz_unregister, tz);
+	if (ret)
+		return ret;
+
+	return thermal_zone_device_enable(tz);
+}
+#endif
+
+// Register a cooling device per fan and, where the thermal core lets us bind
+// them without firmware tables, a thermal zone per temperature sensor
+static int framework_thermal_init(struct framework_data *data)
+{
+	struct device *dev = &data->pdev->dev;
+	struct thermal_cooling_device *cdev;
+	char *name;
+
+	if (!IS_ENABLED(CONFIG_THERMAL) ||
+	    !fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0, FW_CAP_FAN_DUTY_V1) ||
+	    !fw_has_fan_cmd(data, FW_CAP_FAN_AUTO_V0, FW_CAP_FAN_AUTO_V1))
+		return 0;
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		struct fw_fan_cooling *cooling = &data->cooling[i];
+
+		cooling->data = data;
+		cooling->idx = i;
+
+		name = devm_kasprintf(dev, GFP_KERNEL, DRV_NAME "-fan%zu", i + 1);
+		if (!name)
+			return -ENOMEM;
+
+		cdev = devm_thermal_of_cooling_device_register(dev, NULL, name,
+							      cooling,
+							      &fw_cooling_ops);
+		if (IS_ERR(cdev))
+			return PTR_ERR(cdev);
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+	for (size_t i = 0; i < EC_TEMP_SENSOR_ENTRIES; i++) {
+		int ret;
+
+		if (!test_bit(i, &data->temp_present))
+			continue;
+
+		ret = framework_thermal_zone_init(data, i);
+		if (ret)
+			return ret;
+	}
+#endif
+
+	return 0;
+}
+
+// --- generic sysfs attributes ---
+static DEVICE_ATTR_RO(framework_privacy);
+
+static struct attribute *framework_laptop_attrs[] = {
+	&dev_attr_framework_privacy.attr,
+	NULL,
+};
+
+static umode_t framework_laptop_attr_is_visible(struct kobject *kobj,
+						struct attribute *attr, int n)
+{
+	struct framework_data *data = dev_get_drvdata(kobj_to_dev(kobj));
+
+	if (attr == &dev_attr_framework_privacy.attr &&
+	    !fw_has(data, FW_CAP_PRIVACY))
+		return 0;
+
+	return attr->mode;
+}
+
+static const struct attribute_group framework_laptop_group = {
+	.attrs = framework_laptop_attrs,
+	.is_visible = framework_laptop_attr_is_visible,
+};
+
+__ATTRIBUTE_GROUPS(framework_laptop);
+
+// --- debugfs ---
+static int memmap_cache_show(struct seq_file *s, void *unused)
+{
+	struct framework_data *data = s->private;
+	struct fw_memmap_cache *cache = &data->memmap;
+
+	mutex_lock(&data->lock);
+	seq_printf(s, "hits: %llu\n", cache->hits);
+	seq_printf(s, "ec_reads: %llu\n", cache->reads);
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(memmap_cache);
+
+static void ec_latency_show_slot(struct seq_file *s,
+				 struct framework_data *data, const char *name,
+				 unsigned int slot)
+{
+	struct fw_ec_cmd_stats sum = {};
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fw_ec_cmd_stats *stats =
+			&per_cpu_ptr(data->stats, cpu)->cmd[slot];
+
+		sum.calls += stats->calls;
+		sum.errors += stats->errors;
+		sum.total_ns += stats->total_ns;
+		sum.max_ns = max(sum.max_ns, stats->max_ns);
+		for (unsigned int i = 0; i < FW_EC_LAT_BUCKETS; i++)
+			sum.buckets[i] += stats->buckets[i];
+	}
+
+	if (!sum.calls)
+		return;
+
+	seq_printf(s, "%s: calls %llu errors %llu avg_us %llu max_us %llu\n",
+		   name, sum.calls, sum.errors,
+		   div_u64(div64_u64(sum.total_ns, sum.calls), NSEC_PER_USEC),
+		   div_u64(sum.max_ns, NSEC_PER_USEC));
+
+	for (unsigned int i = 0; i < FW_EC_LAT_BUCKETS; i++) {
+		if (!sum.buckets[i])
+			continue;
+
+		if (i == FW_EC_LAT_BUCKETS - 1)
+			seq_printf(s, "  >= %lu us: %llu\n", 1UL << (i - 1),
+				   sum.buckets[i]);
+		else
+			seq_printf(s, "  < %lu us: %llu\n", 1UL << i,
+				   sum.buckets[i]);
+	}
+}
+
+static int ec_latency_show(struct seq_file *s, void *unused)
+{
+	struct framework_data *data = s->private;
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(fw_ec_cmd_names); i++)
+		ec_latency_show_slot(s, data, fw_ec_cmd_names[i].name, i);
+
+	ec_latency_show_slot(s, data, "readmem", FW_EC_STAT_READMEM);
+	ec_latency_show_slot(s, data, "other", FW_EC_STAT_OTHER);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_latency);
+
+static int fan_shadow_show(struct seq_file *s, void *unused)
+{
+	struct framework_data *data = s->private;
+
+	mutex_lock(&data->lock);
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		struct fw_fan_shadow *shadow = &data->shadows[i];
+
+		seq_printf(s, "fan%zu: duty_suppressed %llu target_suppressed %llu\n",
+			   i + 1, shadow->duty_suppressed,
+			   shadow->target_suppressed);
+	}
+
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fan_shadow);
+
+static int fan_stalls_show(struct seq_file *s, void *unused)
+{
+	struct framework_data *data = s->private;
+	u64 now = ktime_get_ns();
+
+	mutex_lock(&data->lock);
+
+	for (size_t i = 0; i < data->fan_count; i++) {
+		struct fw_fan_monitor *mon = &data->monitors[i];
+		u64 current_ns = mon->stalled ? now - mon->stall_start : 0;
+
+		seq_printf(s, "fan%zu: stalled %d alarm %d fault %d episodes %llu total_ms %llu max_ms %llu current_ms %llu\n",
+			   i + 1, mon->stalled, mon->alarm, mon->fault,
+			   mon->episodes,
+			   div_u64(mon->stall_total_ns + current_ns,
+				   NSEC_PER_MSEC),
+			   div_u64(max(mon->stall_max_ns, current_ns),
+				   NSEC_PER_MSEC),
+			   div_u64(current_ns, NSEC_PER_MSEC));
+	}
+
+	mutex_unlock(&data->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fan_stalls);
+
+static int ec_caps_show(struct seq_file *s, void *unused)
+{
+	struct framework_data *data = s->private;
+
+	for (unsigned int i = 0; i < FW_CAP_COUNT; i++)
+		seq_printf(s, "%s: %s\n", fw_caps[i].name,
+			   fw_has(data, i) ? "yes" : "no");
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_caps);
+
+static void framework_debugfs_init(struct framework_data *data)
+{
+	data->debugfs = debugfs_create_dir(dev_name(&data->pdev->dev), NULL);
+
+	debugfs_create_file("memmap_cache", 0444, data->debugfs, data,
+			    &memmap_cache_fops);
+	debugfs_create_file("ec_latency", 0444, data->debugfs, data,
+			    &ec_latency_fops);
+	debugfs_create_file("fan_shadow", 0444, data->debugfs, data,
+			    &fan_shadow_fops);
+	debugfs_create_file("fan_stalls", 0444, data->debugfs, data,
+			    &fan_stalls_fops);
+	debugfs_create_file("ec_caps", 0444, data->debugfs, data,
+			    &ec_caps_fops);
+}
+
+// --- telemetry ---
+static_assert(FRAMEWORK_LAPTOP_FANS == EC_FAN_SPEED_ENTRIES);
+static_assert(sizeof(struct framework_laptop_batch) < (1 << _IOC_SIZEBITS));
+static_assert(FRAMEWORK_LAPTOP_TEMPS == EC_TEMP_SENSOR_ENTRIES);
+static_assert(FRAMEWORK_LAPTOP_FAN_NOT_PRESENT == EC_FAN_SPEED_NOT_PRESENT);
+static_assert(FRAMEWORK_LAPTOP_FAN_STALLED == EC_FAN_SPEED_STALLED);
+static_assert(sizeof(struct framework_laptop_telemetry) <= PAGE_SIZE);
+
+// Refresh the telemetry page, costing at most one memmap read plus a charge
+// limit query after it was invalidated
+static void fw_telemetry_fill(struct framework_data *data)
+{
+	struct framework_laptop_telemetry *t = data->telemetry;
+	struct fw_memmap_snapshot snap;
+	bool have_snap;
+	int limit = -ENODATA;
+
+	lockdep_assert_held(&data->lock);
+
+	have_snap = data->ec->cmd_readmem &&
+		    !ec_read_memmap_snapshot(data, &snap);
+	if (fw_has(data, FW_CAP_CHARGE_LIMIT))
+		limit = fw_charge_limit(data);
+
+	// Readers retry while seq is odd
+	WRITE_ONCE(t->seq, t->seq + 1);
+	smp_wmb();
+
+	t->timestamp_ns = ktime_get_ns();
+	t->fan_count = data->fan_count;
+
+	for (size_t i = 0; i < FRAMEWORK_LAPTOP_FANS; i++)
+		t->fan_rpm[i] = have_snap ? snap.fans[i] :
+					    FRAMEWORK_LAPTOP_FAN_NOT_PRESENT;
+
+	t->temp_valid = 0;
+	for (size_t i = 0; i < FRAMEWORK_LAPTOP_TEMPS; i++) {
+		t->temp[i] = 0;
+		if (!have_snap || !test_bit(i, &data->temp_present) ||
+		    ec_temp_is_error(snap.temps[i]))
+			continue;
+
+		t->temp[i] = kelvin_to_millicelsius(snap.temps[i] +
+						    EC_TEMP_SENSOR_OFFSET);
+		t->temp_valid |= BIT(i);
+	}
+
+	t->charge_limit = limit < 0 ? 0 : limit;
+	t->kb_brightness = READ_ONCE(data->kb_led_brightness);
+
+	t->privacy = 0;
+	if (data->privacy_valid)
+		t->privacy = FRAMEWORK_LAPTOP_PRIVACY_VALID |
+			     (data->privacy.microphone ?
+				      FRAMEWORK_LAPTOP_PRIVACY_MIC_ON : 0) |
+			     (data->privacy.camera ?
+				      FRAMEWORK_LAPTOP_PRIVACY_CAMERA_ON : 0);
+
+	smp_wmb();
+	WRITE_ONCE(t->seq, t->seq + 1);
+}
+
+// --- telemetry netlink ---
+static struct genl_family fw_genl_family;
+
+// The family is global, so it serves the first instance only. fw_nl_lock
+// keeps CMD_GET away from a device that is going away.
+static DEFINE_MUTEX(fw_nl_lock);
+static struct framework_data *fw_nl_data;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+// The bind callback runs before the socket joins the group, so the sampler
+// counts as having listeners for a while after it
+#define FW_NL_BIND_GRACE HZ
+
+static unsigned long fw_nl_bind_time;
+#else
+// How often to check for new subscribers while nobody is listening
+#define FW_NL_WATCH_MS 1000
+#endif
+
+static int fw_nl_put_indexed(struct sk_buff *skb, int type, u8 idx,
+			     bool has_value, u32 value)
+{
+	struct nlattr *nest = nla_nest_start(skb, type);
+
+	if (!nest)
+		return -EMSGSIZE;
+
+	if (nla_put_u8(skb, FRAMEWORK_LAPTOP_ATTR_INDEX, idx) ||
+	    (has_value && nla_put_u32(skb, FRAMEWORK_LAPTOP_ATTR_VALUE, value))) {
+		nla_nest_cancel(skb, nest);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(skb, nest);
+
+	return 0;
+}
+
+// Put every value that differs from prev, or all of them without prev.
+// Returns the number of values put.
+static int fw_nl_put_state(struct sk_buff *skb,
+			   const struct framework_laptop_telemetry *t,
+			   const struct framework_laptop_telemetry *prev)
+{
+	int count = 0;
+
+	if (nla_put_u64_64bit(skb, FRAMEWORK_LAPTOP_ATTR_TIMESTAMP,
+			      t->timestamp_ns, FRAMEWORK_LAPTOP_ATTR_PAD))
+		return -EMSGSIZE;
+
+	for (u8 i = 0; i < t->fan_count; i++) {
+		if (prev && prev->fan_rpm[i] == t->fan_rpm[i])
+			continue;
+
+		if (fw_nl_put_indexed(skb, FRAMEWORK_LAPTOP_ATTR_FAN, i, true,
+				      t->fan_rpm[i]))
+			return -EMSGSIZE;
+		count++;
+	}
+
+	for (u8 i = 0; i < FRAMEWORK_LAPTOP_TEMPS; i++) {
+		bool valid = t->temp_valid & BIT(i);
+
+		if (prev) {
+			bool was_valid = prev->temp_valid & BIT(i);
+
+			if (valid == was_valid &&
+			    (!valid || prev->temp[i] == t->temp[i]))
+				continue;
+		} else if (!valid) {
+			continue;
+		}
+
+		// A sensor that stopped reporting is sent without a value
+		if (fw_nl_put_indexed(skb, FRAMEWORK_LAPTOP_ATTR_TEMP, i, valid,
+				      (u32)t->temp[i]))
+			return -EMSGSIZE;
+		count++;
+	}
+
+	if (!prev || prev->charge_limit != t->charge_limit) {
+		if (nla_put_u8(skb, FRAMEWORK_LAPTOP_ATTR_CHARGE_LIMIT,
+			       t->charge_limit))
+			return -EMSGSIZE;
+		count++;
+	}
+
+	if (!prev || prev->privacy != t->privacy) {
+		if (nla_put_u8(skb, FRAMEWORK_LAPTOP_ATTR_PRIVACY, t->privacy))
+			return -EMSGSIZE;
+		count++;
+	}
+
+	return count;
+}
+
+// Build a message with what changed since the last broadcast, if anything
+static struct sk_buff *fw_nl_build_update(struct framework_data *data)
+{
+	struct sk_buff *skb;
+	void *hdr;
+
+	lockdep_assert_held(&data->lock);
+
+	skb = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	hdr = genlmsg_put(skb, 0, 0, &fw_genl_family, 0,
+			  FRAMEWORK_LAPTOP_CMD_TELEMETRY);
+	if (!hdr)
+		goto fail;
+
+	if (fw_nl_put_state(skb, data->telemetry,
+			    data->nl_last_valid ? &data->nl_last : NULL) <= 0)
+		goto fail;
+
+	genlmsg_end(skb, hdr);
+
+	data->nl_last = *data->telemetry;
+	data->nl_last_valid = true;
+
+	return skb;
+
+fail:
+	nlmsg_free(skb);
+	return NULL;
+}
+
+static int fw_nl_get_doit(struct sk_buff *skb, struct genl_info *info)
+{
+	struct framework_data *data;
+	struct sk_buff *msg;
+	void *hdr;
+	int ret;
+
+	mutex_lock(&fw_nl_lock);
+
+	data = fw_nl_data;
+	if (!data) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	msg = genlmsg_new(NLMSG_GOODSIZE, GFP_KERNEL);
+	if (!msg) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	hdr = genlmsg_put_reply(msg, info, &fw_genl_family, 0,
+				FRAMEWORK_LAPTOP_CMD_GET);
+	if (!hdr) {
+		nlmsg_free(msg);
+		ret = -EMSGSIZE;
+		goto out;
+	}
+
+	mutex_lock(&data->lock);
+	fw_telemetry_fill(data);
+	ret = fw_nl_put_state(msg, data->telemetry, NULL);
+	mutex_unlock(&data->lock);
+	if (ret < 0) {
+		nlmsg_free(msg);
+		goto out;
+	}
+
+	genlmsg_end(msg, hdr);
+	ret = genlmsg_reply(msg, info);
+
+out:
+	mutex_unlock(&fw_nl_lock);
+	return ret;
+}
+
+static const struct nla_policy fw_genl_policy[FRAMEWORK_LAPTOP_ATTR_MAX + 1] = {
+	[FRAMEWORK_LAPTOP_ATTR_TIMESTAMP] = { .type = NLA_U64 },
+	[FRAMEWORK_LAPTOP_ATTR_FAN] = { .type = NLA_NESTED },
+	[FRAMEWORK_LAPTOP_ATTR_TEMP] = { .type = NLA_NESTED },
+	[FRAMEWORK_LAPTOP_ATTR_CHARGE_LIMIT] = { .type = NLA_U8 },
+	[FRAMEWORK_LAPTOP_ATTR_PRIVACY] = { .type = NLA_U8 },
+	[FRAMEWORK_LAPTOP_ATTR_INDEX] = { .type = NLA_U8 },
+	[FRAMEWORK_LAPTOP_ATTR_VALUE] = { .type = NLA_U32 },
+};
+
+static const struct genl_ops fw_genl_ops[] = {
+	{
+		.cmd = FRAMEWORK_LAPTOP_CMD_GET,
+		.doit = fw_nl_get_doit,
+	},
+};
+
+static const struct genl_multicast_group fw_genl_mcgrps[] = {
+	{ .name = FRAMEWORK_LAPTOP_GENL_MCGRP_TELEMETRY },
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+// Start the sampler when someone subscribes, it stops by itself once the
+// last subscriber left
+static int fw_nl_bind(int mcgrp)
+{
+	WRITE_ONCE(fw_nl_bind_time, jiffies);
+
+	// A no-op if the sampler is already running
+	mutex_lock(&fw_nl_lock);
+	if (fw_nl_data)
+		schedule_delayed_work(&fw_nl_data->telemetry_work, 0);
+	mutex_unlock(&fw_nl_lock);
+
+	return 0;
+}
+#endif
+
+static struct genl_family fw_genl_family = {
+	.name = FRAMEWORK_LAPTOP_GENL_NAME,
+	.version = FRAMEWORK_LAPTOP_GENL_VERSION,
+	.maxattr = FRAMEWORK_LAPTOP_ATTR_MAX,
+	.policy = fw_genl_policy,
+	.module = THIS_MODULE,
+	.ops = fw_genl_ops,
+	.n_ops = ARRAY_SIZE(fw_genl_ops),
+	.mcgrps = fw_genl_mcgrps,
+	.n_mcgrps = ARRAY_SIZE(fw_genl_mcgrps),
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+	.bind = fw_nl_bind,
+#endif
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+static bool fw_nl_listening(void)
+{
+	return genl_has_listeners(&fw_genl_family, &init_net, 0) ||
+	       time_before(jiffies,
+			   READ_ONCE(fw_nl_bind_time) + FW_NL_BIND_GRACE);
+}
+
+static void fw_nl_watch_init(struct framework_data *data)
+{
+}
+
+// Catch up with subscribers that joined while the sampler couldn't run
+static void fw_nl_watch_start(struct framework_data *data)
+{
+	if (fw_nl_listening())
+		schedule_delayed_work(&data->telemetry_work, 0);
+}
+
+static void fw_nl_watch_stop(struct framework_data *data)
+{
+}
+#else
+static bool fw_nl_listening(void)
+{
+	return genl_has_listeners(&fw_genl_family, &init_net, 0);
+}
+
+// Without bind callbacks, start the sampler when someone subscribes by
+// checking for listeners. Deferrable, so checking doesn't wake an idle CPU.
+static void fw_nl_watch_work_fn(struct work_struct *work)
+{
+	struct framework_data *data = container_of(
+		to_delayed_work(work), struct framework_data, nl_watch_work);
+
+	// A no-op if the sampler is already running
+	if (fw_nl_listening())
+		schedule_delayed_work(&data->telemetry_work, 0);
+
+	schedule_delayed_work(&data->nl_watch_work,
+			      msecs_to_jiffies(FW_NL_WATCH_MS));
+}
+
+static void fw_nl_watch_init(struct framework_data *data)
+{
+	INIT_DEFERRABLE_WORK(&data->nl_watch_work, fw_nl_watch_work_fn);
+}
+
+static void fw_nl_watch_start(struct framework_data *data)
+{
+	schedule_delayed_work(&data->nl_watch_work, 0);
+}
+
+static void fw_nl_watch_stop(struct framework_data *data)
+{
+	cancel_delayed_work_sync(&data->nl_watch_work);
+}
+#endif
+
+// --- telemetry sampler ---
+// Feeds both the mapped page and the netlink subscribers, while either has
+// any users
+static unsigned long fw_telemetry_interval(void)
+{
+	return msecs_to_jiffies(max(sample_interval_ms, 10U));
+}
+
+static void fw_telemetry_work_fn(struct work_struct *work)
+{
+	struct framework_data *data = container_of(
+		to_delayed_work(work), struct framework_data, telemetry_work);
+	struct sk_buff *skb = NULL;
+	bool active, listening;
+
+	mutex_lock(&data->lock);
+
+	listening = READ_ONCE(fw_nl_data) == data && fw_nl_listening();
+	active = data->telemetry_users || listening;
+	if (active)
+		fw_telemetry_fill(data);
+
+	if (listening)
+		skb = fw_nl_build_update(data);
+	else
+		// The next subscriber starts with a full update
+		data->nl_last_valid = false;
+
+	mutex_unlock(&data->lock);
+
+	if (skb)
+		genlmsg_multicast(&fw_genl_family, skb, 0, 0, GFP_KERNEL);
+
+	// Stops by itself once the last file is closed and the last
+	// subscriber left
+	if (active)
+		schedule_delayed_work(&data->telemetry_work,
+				      fw_telemetry_interval());
+}
+
+// --- /dev/framework_laptop ---
+static DEFINE_IDA(fw_chardev_ida);
+
+static void fw_chardev_free(struct kref *ref)
+{
+	struct fw_chardev *cdev = container_of(ref, struct fw_chardev, ref);
+
+	ida_free(&fw_chardev_ida, cdev->id);
+	kfree(cdev);
+}
+
+static struct fw_chardev *fw_chardev_get(struct file *file)
+{
+	// The misc core points private_data at our miscdevice
+	return container_of(file->private_data, struct fw_chardev, misc);
+}
+
+static int fw_chardev_open(struct inode *inode, struct file *file)
 {
-	if (!ec_device)
+	struct fw_chardev *cdev = fw_chardev_get(file);
+	struct framework_data *data;
+
+	// Still registered, so the device's reference is still there
+	kref_get(&cdev->ref);
+
+	mutex_lock(&cdev->lock);
+
+	data = cdev->data;
+	if (!data) {
+		mutex_unlock(&cdev->lock);
+		kref_put(&cdev->ref, fw_chardev_free);
 		return -ENODEV;
+	}
+
+	mutex_lock(&data->lock);
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+	// The first user gets a fresh page right away
+	if (!data->telemetry_users++) {
+		fw_telemetry_fill(data);
+		mod_delayed_work(system_wq, &data->telemetry_work,
+				 fw_telemetry_interval());
+	}
 
-	const u8 offset = EC_MEMMAP_FAN + 2 * idx;
+	mutex_unlock(&data->lock);
+	mutex_unlock(&cdev->lock);
 
-	return ec->cmd_readmem(ec, offset, sizeof(*val), val);
+	return 0;
 }
 
-static ssize_t fw_fan_speed_show(struct device *dev,
-				 struct device_attribute *attr, char *buf)
+static int fw_chardev_release(struct inode *inode, struct file *file)
 {
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
+	struct fw_chardev *cdev = fw_chardev_get(file);
+	struct framework_data *data;
+	int ret = 0;
 
-	u16 val;
-	if (ec_get_fan_speed(sen_attr->index, &val) < 0) {
-		return -EIO;
-	}
+	mutex_lock(&cdev->lock);
 
-	if (val == EC_FAN_SPEED_NOT_PRESENT || val == EC_FAN_SPEED_STALLED) {
-		return sysfs_emit(buf, "%u\n", 0);
+	data = cdev->data;
+	if (data) {
+		mutex_lock(&data->lock);
+		data->telemetry_users--;
+		mutex_unlock(&data->lock);
+	} else {
+		ret = -ENODEV;
 	}
 
-	// Format as string for sysfs
-	return sysfs_emit(buf, "%u\n", val);
+	mutex_unlock(&cdev->lock);
+
+	kref_put(&cdev->ref, fw_chardev_free);
+
+	return ret;
 }
 
-// --- fanN_target ---
-static ssize_t ec_set_target_rpm(u8 idx, u32 *val)
+static int fw_chardev_mmap(struct file *file, struct vm_area_struct *vma)
 {
+	struct fw_chardev *cdev = fw_chardev_get(file);
 	int ret;
-	if (!ec_device)
-		return -ENODEV;
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
 
-	struct ec_params_pwm_set_fan_target_rpm_v1 params = {
-		.rpm = *val,
-		.fan_idx = idx,
-	};
+	// The page is only ever written by the driver
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
 
-	ret = cros_ec_cmd(ec, 1, EC_CMD_PWM_SET_FAN_TARGET_RPM, &params,
-			  sizeof(params), NULL, 0);
-	if (ret < 0)
-		return -EIO;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
 
-	return 0;
+	// The mapping holds its own reference to the page
+	mutex_lock(&cdev->lock);
+	if (cdev->data)
+		ret = vm_insert_page(vma, vma->vm_start,
+				     virt_to_page(cdev->data->telemetry));
+	else
+		ret = -ENODEV;
+	mutex_unlock(&cdev->lock);
+
+	return ret;
 }
 
-static ssize_t ec_get_target_rpm(u8 idx, u32 *val)
+static int fw_batch_op(struct framework_data *data, bool writable,
+		       const struct framework_laptop_op *op,
+		       struct framework_laptop_batch *batch, bool *kb_changed)
 {
+	bool fan_ok = op->index < data->fan_count;
 	int ret;
-	if (!ec_device)
-		return -ENODEV;
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+	lockdep_assert_held(&data->lock);
 
-	struct ec_response_pwm_get_fan_rpm resp;
+	if (op->type != FRAMEWORK_LAPTOP_OP_READ_SNAPSHOT && !writable)
+		return -EPERM;
 
-	// index isn't supported, it should only return fan 0's target
+	switch (op->type) {
+	case FRAMEWORK_LAPTOP_OP_SET_CHARGE_LIMIT:
+		if (!fw_has(data, FW_CAP_CHARGE_LIMIT))
+			return -EOPNOTSUPP;
+		if (op->value > 100)
+			return -EINVAL;
 
-	ret = cros_ec_cmd(ec, 0, EC_CMD_PWM_GET_FAN_TARGET_RPM, NULL, 0, &resp,
-			  sizeof(resp));
-	if (ret < 0)
-		return -EIO;
+		return fw_set_charge_limit(data, op->value);
+	case FRAMEWORK_LAPTOP_OP_SET_FAN_DUTY:
+		if (!fan_ok || op->value > 100)
+			return -EINVAL;
+		if (!fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0, FW_CAP_FAN_DUTY_V1))
+			return -EOPNOTSUPP;
 
-	*val = resp.rpm;
+		ret = fw_fan_set_duty(data, op->index, op->value);
+		if (ret < 0)
+			return ret;
 
-	return 0;
-}
+		data->shadows[op->index].mode = FW_PWM_ENABLE_MANUAL;
+		return 0;
+	case FRAMEWORK_LAPTOP_OP_SET_FAN_TARGET:
+		if (!fan_ok)
+			return -EINVAL;
+		if (!fw_has_fan_cmd(data, FW_CAP_FAN_TARGET_SET_V0,
+				    FW_CAP_FAN_TARGET_SET_V1))
+			return -EOPNOTSUPP;
 
-static ssize_t fw_fan_target_store(struct device *dev,
-				   struct device_attribute *attr,
-				   const char *buf, size_t count)
-{
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
-	u32 val;
+		ret = fw_fan_set_target(data, op->index, op->value);
+		if (ret < 0)
+			return ret;
 
-	int err;
-	err = kstrtou32(buf, 10, &val);
-	if (err < 0)
-		return err;
+		data->shadows[op->index].mode = FW_PWM_ENABLE_MANUAL;
+		return 0;
+	case FRAMEWORK_LAPTOP_OP_SET_FAN_AUTO:
+		if (!fan_ok)
+			return -EINVAL;
+		if (!fw_has_fan_cmd(data, FW_CAP_FAN_AUTO_V0, FW_CAP_FAN_AUTO_V1))
+			return -EOPNOTSUPP;
 
-	if (ec_set_target_rpm(sen_attr->index, &val) < 0) {
-		return -EIO;
-	}
+		ret = fw_fan_set_auto(data, op->index);
+		if (ret < 0)
+			return ret;
 
-	return count;
+		data->shadows[op->index].mode = FW_PWM_ENABLE_AUTO;
+		return 0;
+	case FRAMEWORK_LAPTOP_OP_SET_KB_BRIGHTNESS:
+		if (op->value > 100)
+			return -EINVAL;
+		if (!fw_has(data, FW_CAP_KB_LED_GET) ||
+		    !fw_has(data, FW_CAP_KB_LED_SET))
+			return -EOPNOTSUPP;
+
+		ret = ec_set_kb_led_brightness(data, op->value);
+		if (ret < 0)
+			return ret;
+
+		// A flush still being coalesced must not undo this
+		WRITE_ONCE(data->kb_led_last_flush, jiffies);
+		spin_lock_irq(&data->kb_led_state_lock);
+		data->kb_led_pending = op->value;
+		data->kb_led_gen_written = ++data->kb_led_gen;
+		if (data->kb_led_brightness != op->value) {
+			WRITE_ONCE(data->kb_led_brightness, op->value);
+			*kb_changed = true;
+		}
+		spin_unlock_irq(&data->kb_led_state_lock);
+		return 0;
+	case FRAMEWORK_LAPTOP_OP_READ_SNAPSHOT:
+		fw_telemetry_fill(data);
+		batch->snapshot = *data->telemetry;
+		return 0;
+	default:
+		return -EINVAL;
+	}
 }
 
-static ssize_t fw_fan_target_show(struct device *dev,
-				  struct device_attribute *attr, char *buf)
+// Run every operation under one acquisition of the EC lock
+static void fw_batch_run(struct framework_data *data, bool writable,
+			 struct framework_laptop_batch *batch)
 {
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
+	bool kb_changed = false;
+	bool failed = false;
 
-	// Only fan 0 is supported
-	if (sen_attr->index != 0) {
-		return -EINVAL;
-	}
+	mutex_lock(&data->lock);
 
-	u32 val;
-	if (ec_get_target_rpm(sen_attr->index, &val) < 0) {
-		return -EIO;
+	for (u32 i = 0; i < batch->count; i++) {
+		struct framework_laptop_op *op = &batch->ops[i];
+
+		if (failed &&
+		    (batch->flags & FRAMEWORK_LAPTOP_BATCH_STOP_ON_ERROR)) {
+			op->result = -ECANCELED;
+			continue;
+		}
+
+		op->result = fw_batch_op(data, writable, op, batch, &kb_changed);
+		if (op->result < 0)
+			failed = true;
 	}
 
-	// Format as string for sysfs
-	return sysfs_emit(buf, "%u\n", val);
+	mutex_unlock(&data->lock);
+
+	if (kb_changed)
+		led_classdev_notify_brightness_hw_changed(
+			&data->kb_led, READ_ONCE(data->kb_led_brightness));
 }
 
-// --- fanN_fault ---
-static ssize_t fw_fan_fault_show(struct device *dev,
-				 struct device_attribute *attr, char *buf)
+// Hand all results back with a single copy. User memory is only touched
+// outside of cdev->lock, which mmap takes under the mmap lock.
+static long fw_chardev_batch(struct fw_chardev *cdev, struct file *file,
+			     void __user *argp)
 {
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
+	bool writable = file->f_mode & FMODE_WRITE;
+	struct framework_laptop_batch *batch;
+	long ret = 0;
 
-	u16 val;
-	if (ec_get_fan_speed(sen_attr->index, &val) < 0) {
-		return -EIO;
+	batch = memdup_user(argp, sizeof(*batch));
+	if (IS_ERR(batch))
+		return PTR_ERR(batch);
+
+	if (batch->count > FRAMEWORK_LAPTOP_MAX_OPS ||
+	    batch->flags & ~FRAMEWORK_LAPTOP_BATCH_STOP_ON_ERROR) {
+		ret = -EINVAL;
+		goto out;
 	}
 
-	// Format as string for sysfs
-	return sysfs_emit(buf, "%u\n", val == EC_FAN_SPEED_NOT_PRESENT);
+	mutex_lock(&cdev->lock);
+	if (cdev->data)
+		fw_batch_run(cdev->data, writable, batch);
+	else
+		ret = -ENODEV;
+	mutex_unlock(&cdev->lock);
+	if (ret)
+		goto out;
+
+	if (copy_to_user(argp, batch, sizeof(*batch)))
+		ret = -EFAULT;
+
+out:
+	kfree(batch);
+	return ret;
 }
 
-// --- fanN_alarm ---
-static ssize_t fw_fan_alarm_show(struct device *dev,
-				 struct device_attribute *attr, char *buf)
+static long fw_chardev_ioctl(struct file *file, unsigned int cmd,
+			     unsigned long arg)
 {
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
+	struct fw_chardev *cdev = fw_chardev_get(file);
 
-	u16 val;
-	if (ec_get_fan_speed(sen_attr->index, &val) < 0) {
-		return -EIO;
+	switch (cmd) {
+	case FRAMEWORK_LAPTOP_IOC_BATCH:
+		return fw_chardev_batch(cdev, file, (void __user *)arg);
+	default:
+		return -ENOTTY;
 	}
-
-	// Format as string for sysfs
-	return sysfs_emit(buf, "%u\n", val == EC_FAN_SPEED_STALLED);
 }
 
-// --- pwmN_enable ---
-static ssize_t ec_set_auto_fan_ctrl(u8 idx)
+static const struct file_operations fw_chardev_fops = {
+	.owner = THIS_MODULE,
+	.open = fw_chardev_open,
+	.release = fw_chardev_release,
+	.mmap = fw_chardev_mmap,
+	.unlocked_ioctl = fw_chardev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = noop_llseek,
+};
+
+static void fw_telemetry_free(void *_data)
 {
-	int ret;
-	if (!ec_device)
-		return -ENODEV;
+	struct framework_data *data = _data;
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+	fw_nl_watch_stop(data);
+	cancel_delayed_work_sync(&data->telemetry_work);
+	// Pages still mapped by userspace hold their own reference
+	free_page((unsigned long)data->telemetry);
+}
 
-	struct ec_params_auto_fan_ctrl_v1 params = {
-		.fan_idx = idx,
-	};
+static void fw_chardev_unregister(void *_data)
+{
+	struct framework_data *data = _data;
+	struct fw_chardev *cdev = data->chardev;
 
-	ret = cros_ec_cmd(ec, 1, EC_CMD_THERMAL_AUTO_FAN_CTRL, &params,
-			  sizeof(params), NULL, 0);
-	if (ret < 0)
-		return -EIO;
+	// Waits for opens in progress, but not for open files
+	misc_deregister(&cdev->misc);
 
-	return 0;
+	// From here on, open files only get -ENODEV
+	mutex_lock(&cdev->lock);
+	cdev->data = NULL;
+	mutex_unlock(&cdev->lock);
+
+	kref_put(&cdev->ref, fw_chardev_free);
 }
 
-static ssize_t fw_pwm_enable_store(struct device *dev,
-				   struct device_attribute *attr,
-				   const char *buf, size_t count)
+// The page and sampler behind both /dev/framework_laptop and netlink
+static int framework_telemetry_init(struct framework_data *data)
 {
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
-
-	// The EC doesn't take any arguments for this command,
-	// so we don't need to parse the buffer
-	// u32 val;
-
-	// int err;
-	// err = kstrtou32(buf, 10, &val);
-	// if (err < 0)
-	// 	return err;
+	data->telemetry = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!data->telemetry)
+		return -ENOMEM;
 
-	if (ec_set_auto_fan_ctrl(sen_attr->index) < 0) {
-		return -EIO;
-	}
+	data->telemetry->version = FRAMEWORK_LAPTOP_TELEMETRY_VERSION;
+	INIT_DELAYED_WORK(&data->telemetry_work, fw_telemetry_work_fn);
+	fw_nl_watch_init(data);
 
-	return count;
+	return devm_add_action_or_reset(&data->pdev->dev, fw_telemetry_free,
+					data);
 }
 
-// --- pwmN ---
-static ssize_t ec_set_fan_duty(u8 idx, u32 *val)
+static int framework_chardev_init(struct framework_data *data)
 {
+	struct device *dev = &data->pdev->dev;
+	struct fw_chardev *cdev;
 	int ret;
-	if (!ec_device)
-		return -ENODEV;
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
-
-	struct ec_params_pwm_set_fan_duty_v1 params = {
-		.percent = *val,
-		.fan_idx = idx,
-	};
+	cdev = kzalloc(sizeof(*cdev), GFP_KERNEL);
+	if (!cdev)
+		return -ENOMEM;
 
-	ret = cros_ec_cmd(ec, 1, EC_CMD_PWM_SET_FAN_DUTY, &params,
-			  sizeof(params), NULL, 0);
-	if (ret < 0)
-		return -EIO;
+	cdev->id = ida_alloc(&fw_chardev_ida, GFP_KERNEL);
+	if (cdev->id < 0) {
+		ret = cdev->id;
+		kfree(cdev);
+		return ret;
+	}
 
-	return 0;
-}
+	kref_init(&cdev->ref);
+	mutex_init(&cdev->lock);
+	cdev->data = data;
 
-static ssize_t fw_pwm_store(struct device *dev, struct device_attribute *attr,
-			    const char *buf, size_t count)
-{
-	struct sensor_device_attribute *sen_attr = to_sensor_dev_attr(attr);
-	u32 val;
+	// The first instance keeps the plain name
+	if (cdev->id)
+		snprintf(cdev->name, sizeof(cdev->name), DRV_NAME "%d",
+			 cdev->id);
+	else
+		strscpy(cdev->name, DRV_NAME, sizeof(cdev->name));
 
-	int err;
-	err = kstrtou32(buf, 10, &val);
-	if (err < 0)
-		return err;
+	cdev->misc.minor = MISC_DYNAMIC_MINOR;
+	cdev->misc.name = cdev->name;
+	cdev->misc.fops = &fw_chardev_fops;
+	cdev->misc.parent = dev;
+	cdev->misc.mode = 0444;
 
-	if (ec_set_fan_duty(sen_attr->index, &val) < 0) {
-		return -EIO;
+	ret = misc_register(&cdev->misc);
+	if (ret) {
+		kref_put(&cdev->ref, fw_chardev_free);
+		return ret;
 	}
 
-	return count;
+	data->chardev = cdev;
+
+	return devm_add_action_or_reset(dev, fw_chardev_unregister, data);
 }
 
-static ssize_t fw_pwm_min_show(struct device *dev,
-			       struct device_attribute *attr, char *buf)
+// --- change notifications ---
+// Compare the fan states and the charge limit with the previous check, and
+// notify on transitions only, so that userspace can sleep in poll() on the
+// attributes instead of re-reading them. Privacy switch changes are notified
+// where the switches are refreshed.
+static bool framework_events_wanted(struct framework_data *data)
 {
-	return sysfs_emit(buf, "%i\n", 0);
+	return data->hwmon_dev || fw_has(data, FW_CAP_CHARGE_LIMIT);
 }
 
-static ssize_t fw_pwm_max_show(struct device *dev,
-			       struct device_attribute *attr, char *buf)
+static void fw_fan_stall_end(struct fw_fan_monitor *mon, u64 now)
 {
-	return sysfs_emit(buf, "%i\n", 100);
+	u64 duration = now - mon->stall_start;
+
+	mon->stall_total_ns += duration;
+	mon->stall_max_ns = max(mon->stall_max_ns, duration);
+	mon->stalled = false;
 }
 
-static ssize_t ec_count_fans(size_t *val)
+// Feed one sample of a fan to its monitor. A stall or a missing fan only
+// counts once it was seen in fan_stall_debounce samples in a row. Reports
+// whether fanN_alarm or fanN_fault changed.
+static void fw_fan_monitor_update(struct fw_fan_monitor *mon, u16 fan,
+				  u64 now, bool *alarm_changed,
+				  bool *fault_changed)
 {
-	if (!ec_device)
-		return -ENODEV;
+	unsigned int debounce = max(READ_ONCE(fan_stall_debounce), 1U);
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+	*alarm_changed = false;
+	*fault_changed = false;
 
-	u16 fans[EC_FAN_SPEED_ENTRIES];
-
-	int ret = ec->cmd_readmem(ec, EC_MEMMAP_FAN, sizeof(fans), fans);
-	if (ret < 0)
-		return -EIO;
+	if (fan == EC_FAN_SPEED_STALLED) {
+		// The episode is timed from its first sample
+		if (!mon->stall_samples++)
+			mon->stall_start = now;
 
-	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++) {
-		if (fans[i] == EC_FAN_SPEED_NOT_PRESENT) {
-			*val = i;
-			return 0;
+		if (!mon->stalled && mon->stall_samples >= debounce) {
+			mon->stalled = true;
+			mon->episodes++;
+			*alarm_changed = !mon->alarm;
+			mon->alarm = true;
 		}
+	} else {
+		// The alarm stays latched until it is read
+		if (mon->stalled)
+			fw_fan_stall_end(mon, now);
+		mon->stall_samples = 0;
 	}
 
-	*val = EC_FAN_SPEED_ENTRIES;
-	return 0;
+	if (fan == EC_FAN_SPEED_NOT_PRESENT) {
+		if (!mon->fault && ++mon->fault_samples >= debounce) {
+			mon->fault = true;
+			*fault_changed = true;
+		}
+	} else {
+		mon->fault_samples = 0;
+		if (mon->fault) {
+			mon->fault = false;
+			*fault_changed = true;
+		}
+	}
 }
 
-// --- framework_privacy ---
-static ssize_t framework_privacy_show(struct device *dev,
-				      struct device_attribute *attr, char *buf)
+static void framework_event_work_fn(struct work_struct *work)
 {
-	int ret;
-	if (!ec_device)
-		return -ENODEV;
+	struct framework_data *data = container_of(
+		to_delayed_work(work), struct framework_data, event_work);
+	unsigned long alarms_changed = 0, faults_changed = 0;
+	struct fw_memmap_snapshot snap;
+	size_t i;
+
+	mutex_lock(&data->lock);
+
+	if (data->hwmon_dev && !ec_read_memmap_snapshot(data, &snap)) {
+		u64 now = ktime_get_ns();
+
+		for (i = 0; i < data->fan_count; i++) {
+			bool alarm, fault;
+
+			fw_fan_monitor_update(&data->monitors[i], snap.fans[i],
+					      now, &alarm, &fault);
+			if (alarm)
+				__set_bit(i, &alarms_changed);
+			if (fault)
+				__set_bit(i, &faults_changed);
+		}
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
+		data->fan_monitor_valid = true;
+	}
 
-	struct ec_response_privacy_switches_check resp;
+	// Only reaches the EC when the cache was dropped by a host event
+	if (fw_has(data, FW_CAP_CHARGE_LIMIT)) {
+		fw_charge_limit(data);
+		fw_charge_limit_notify(data);
+	}
 
-	ret = cros_ec_cmd(ec, 0, EC_CMD_PRIVACY_SWITCHES_CHECK_MODE, NULL, 0,
-			  &resp, sizeof(resp));
-	if (ret < 0)
-		return -EIO;
+	mutex_unlock(&data->lock);
 
-	// Output following dell-privacy's format
-	return sysfs_emit(buf, "[Microphone] [%s]\n[Camera] [%s]\n",
-			  resp.microphone ? "unmuted" : "muted",
-			  resp.camera ? "unmuted" : "muted");
+	// Also sends a uevent for the hwmon device
+	for_each_set_bit(i, &alarms_changed, EC_FAN_SPEED_ENTRIES)
+		hwmon_notify_event(data->hwmon_dev, hwmon_fan, hwmon_fan_alarm,
+				   i);
+	for_each_set_bit(i, &faults_changed, EC_FAN_SPEED_ENTRIES)
+		hwmon_notify_event(data->hwmon_dev, hwmon_fan, hwmon_fan_fault,
+				   i);
+
+	schedule_delayed_work(&data->event_work,
+			      msecs_to_jiffies(event_poll_ms));
 }
 
-#define FW_ATTRS_PER_FAN 8
+static void framework_events_start(struct framework_data *data)
+{
+	if (event_poll_ms && framework_events_wanted(data))
+		schedule_delayed_work(&data->event_work, 0);
+}
 
-// --- hwmon sysfs attributes ---
-// clang-format off
-static SENSOR_DEVICE_ATTR_RO(fan1_input, fw_fan_speed, 0); // Fan Reading
-static SENSOR_DEVICE_ATTR_RW(fan1_target, fw_fan_target, 0); // Target RPM (RW on fan 0 only)
-static SENSOR_DEVICE_ATTR_RO(fan1_fault, fw_fan_fault, 0); // Fan Not Present
-static SENSOR_DEVICE_ATTR_RO(fan1_alarm, fw_fan_alarm, 0); // Fan Stalled
-static SENSOR_DEVICE_ATTR_WO(pwm1_enable, fw_pwm_enable, 0); // Set Fan Control Mode
-static SENSOR_DEVICE_ATTR_WO(pwm1, fw_pwm, 0); // Set Fan Speed
-static SENSOR_DEVICE_ATTR_RO(pwm1_min, fw_pwm_min, 0); // Min Fan Speed
-static SENSOR_DEVICE_ATTR_RO(pwm1_max, fw_pwm_max, 0); // Max Fan Speed
-// clang-format on
+// --- EC host events ---
+// Refresh the state that the EC can change on its own
+static void framework_kick_sync(struct framework_data *data)
+{
+	if (fw_has(data, FW_CAP_KB_LED_GET) && fw_has(data, FW_CAP_KB_LED_SET))
+		schedule_work(&data->kb_led_sync_work);
+	if (fw_has(data, FW_CAP_PRIVACY))
+		mod_delayed_work(system_wq, &data->privacy_work, 0);
+}
 
-static SENSOR_DEVICE_ATTR_RO(fan2_input, fw_fan_speed, 1);
-static SENSOR_DEVICE_ATTR_WO(fan2_target, fw_fan_target, 1);
-static SENSOR_DEVICE_ATTR_RO(fan2_fault, fw_fan_fault, 1);
-static SENSOR_DEVICE_ATTR_RO(fan2_alarm, fw_fan_alarm, 1);
-static SENSOR_DEVICE_ATTR_WO(pwm2_enable, fw_pwm_enable, 1);
-static SENSOR_DEVICE_ATTR_WO(pwm2, fw_pwm, 1);
-static SENSOR_DEVICE_ATTR_RO(pwm2_min, fw_pwm_min, 1);
-static SENSOR_DEVICE_ATTR_RO(pwm2_max, fw_pwm_max, 1);
+static int framework_ec_notify(struct notifier_block *nb,
+			       unsigned long queued_during_suspend,
+			       void *_notify)
+{
+	struct framework_data *data =
+		container_of(nb, struct framework_data, ec_notifier);
+	struct cros_ec_device *ec = _notify;
 
-static SENSOR_DEVICE_ATTR_RO(fan3_input, fw_fan_speed, 2);
-static SENSOR_DEVICE_ATTR_WO(fan3_target, fw_fan_target, 2);
-static SENSOR_DEVICE_ATTR_RO(fan3_fault, fw_fan_fault, 2);
-static SENSOR_DEVICE_ATTR_RO(fan3_alarm, fw_fan_alarm, 2);
-static SENSOR_DEVICE_ATTR_WO(pwm3_enable, fw_pwm_enable, 2);
-static SENSOR_DEVICE_ATTR_WO(pwm3, fw_pwm, 2);
-static SENSOR_DEVICE_ATTR_RO(pwm3_min, fw_pwm_min, 2);
-static SENSOR_DEVICE_ATTR_RO(pwm3_max, fw_pwm_max, 2);
+	// Only host events can reflect a change made behind our back
+	if (!cros_ec_get_host_event(ec))
+		return NOTIFY_DONE;
 
-static SENSOR_DEVICE_ATTR_RO(fan4_input, fw_fan_speed, 3);
-static SENSOR_DEVICE_ATTR_WO(fan4_target, fw_fan_target, 3);
-static SENSOR_DEVICE_ATTR_RO(fan4_fault, fw_fan_fault, 3);
-static SENSOR_DEVICE_ATTR_RO(fan4_alarm, fw_fan_alarm, 3);
-static SENSOR_DEVICE_ATTR_WO(pwm4_enable, fw_pwm_enable, 3);
-static SENSOR_DEVICE_ATTR_WO(pwm4, fw_pwm, 3);
-static SENSOR_DEVICE_ATTR_RO(pwm4_min, fw_pwm_min, 3);
-static SENSOR_DEVICE_ATTR_RO(pwm4_max, fw_pwm_max, 3);
+	framework_invalidate_cache(data);
+	framework_kick_sync(data);
 
-static struct attribute
-	*fw_hwmon_attrs[(EC_FAN_SPEED_ENTRIES * FW_ATTRS_PER_FAN) + 1] = {
-		&sensor_dev_attr_fan1_input.dev_attr.attr,
-		&sensor_dev_attr_fan1_target.dev_attr.attr,
-		&sensor_dev_attr_fan1_fault.dev_attr.attr,
-		&sensor_dev_attr_fan1_alarm.dev_attr.attr,
-		&sensor_dev_attr_pwm1_enable.dev_attr.attr,
-		&sensor_dev_attr_pwm1.dev_attr.attr,
-		&sensor_dev_attr_pwm1_min.dev_attr.attr,
-		&sensor_dev_attr_pwm1_max.dev_attr.attr,
-
-		&sensor_dev_attr_fan2_input.dev_attr.attr,
-		&sensor_dev_attr_fan2_target.dev_attr.attr,
-		&sensor_dev_attr_fan2_fault.dev_attr.attr,
-		&sensor_dev_attr_fan2_alarm.dev_attr.attr,
-		&sensor_dev_attr_pwm2_enable.dev_attr.attr,
-		&sensor_dev_attr_pwm2.dev_attr.attr,
-		&sensor_dev_attr_pwm2_min.dev_attr.attr,
-		&sensor_dev_attr_pwm2_max.dev_attr.attr,
-
-		&sensor_dev_attr_fan3_input.dev_attr.attr,
-		&sensor_dev_attr_fan3_target.dev_attr.attr,
-		&sensor_dev_attr_fan3_fault.dev_attr.attr,
-		&sensor_dev_attr_fan3_alarm.dev_attr.attr,
-		&sensor_dev_attr_pwm3_enable.dev_attr.attr,
-		&sensor_dev_attr_pwm3.dev_attr.attr,
-		&sensor_dev_attr_pwm3_min.dev_attr.attr,
-		&sensor_dev_attr_pwm3_max.dev_attr.attr,
-
-		&sensor_dev_attr_fan4_input.dev_attr.attr,
-		&sensor_dev_attr_fan4_target.dev_attr.attr,
-		&sensor_dev_attr_fan4_fault.dev_attr.attr,
-		&sensor_dev_attr_fan4_alarm.dev_attr.attr,
-		&sensor_dev_attr_pwm4_enable.dev_attr.attr,
-		&sensor_dev_attr_pwm4.dev_attr.attr,
-		&sensor_dev_attr_pwm4_min.dev_attr.attr,
-		&sensor_dev_attr_pwm4_max.dev_attr.attr,
-
-		NULL,
-	};
+	return NOTIFY_OK;
+}
 
-ATTRIBUTE_GROUPS(fw_hwmon);
+// --- power management ---
+static int framework_suspend(struct device *dev)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
+
+	// Don't lose a brightness change that is still being coalesced
+	kb_led_flush(data);
+	cancel_delayed_work_sync(&data->curve_work);
+	// Resume kicks it again through framework_kick_sync()
+	if (fw_has(data, FW_CAP_PRIVACY))
+		cancel_delayed_work_sync(&data->privacy_work);
+	cancel_delayed_work_sync(&data->event_work);
+	fw_nl_watch_stop(data);
+	cancel_delayed_work_sync(&data->telemetry_work);
 
-// --- generic sysfs attributes ---
-static DEVICE_ATTR_RO(framework_privacy);
+	return 0;
+}
 
-static struct attribute *framework_laptop_attrs[] = {
-	&dev_attr_framework_privacy.attr,
-	NULL,
-};
+static int framework_resume(struct device *dev)
+{
+	struct framework_data *data = dev_get_drvdata(dev);
 
-ATTRIBUTE_GROUPS(framework_laptop);
+	// The EC may have changed state while we were asleep
+	framework_invalidate_cache(data);
+	framework_kick_sync(data);
+	fw_fan_restore(data);
+	fw_fan_curve_resync(data);
 
-// --- platform driver ---
-static struct acpi_battery_hook framework_laptop_battery_hook = {
-	.add_battery = framework_laptop_battery_add,
-	.remove_battery = framework_laptop_battery_remove,
-	.name = "Framework Laptop Battery Extension",
-};
+	mutex_lock(&data->lock);
+	if (data->telemetry_users)
+		mod_delayed_work(system_wq, &data->telemetry_work, 0);
+	mutex_unlock(&data->lock);
+	fw_nl_watch_start(data);
+	framework_events_start(data);
+
+	return 0;
+}
 
+static DEFINE_SIMPLE_DEV_PM_OPS(framework_pm_ops, framework_suspend,
+				framework_resume);
+
+// --- platform driver ---
 static const struct acpi_device_id device_ids[] = {
 	{"FRMW0001", 0},
 	{"FRMW0004", 0},
 	{"", 0},
 };
+// Keep the tests from being autoloaded in place of the driver
+#ifndef FRAMEWORK_LAPTOP_KUNIT
 MODULE_DEVICE_TABLE(acpi, device_ids);
+#endif
 
 static const struct dmi_system_id framework_laptop_dmi_table[] __initconst = {
 	{
@@ -669,13 +3495,67 @@ static const struct dmi_system_id framework_laptop_dmi_table[] __initconst = {
 	},
 	{ /* sentinel */ }
 };
+#ifndef FRAMEWORK_LAPTOP_KUNIT
 MODULE_DEVICE_TABLE(dmi, framework_laptop_dmi_table);
+#endif
 
-static int device_match_cros_ec(struct device *dev, const void* foo) {
-	const char* name = dev_name(dev);
-	if (strncmp(name, "cros-ec-dev", 11))
-		return 0;
-	return 1;
+static void framework_put_ec(void *_ec_dev)
+{
+	put_device(_ec_dev);
+}
+
+// Find the EC transport device through the driver bound to it, deferring
+// until there is one. The driver only binds once cros_ec_register() has the
+// EC answering, and its drvdata is the cros_ec_device.
+static int framework_find_ec(struct framework_data *data)
+{
+	struct device *dev = &data->pdev->dev;
+	struct device_driver *ec_drv;
+	struct device *ec_dev;
+	int ret;
+
+	// No reference on the driver, but cros_ec_lpcs is loaded first (see
+	// MODULE_SOFTDEP), and once linked below, unbinding it unbinds us first
+	ec_drv = driver_find(FRAMEWORK_LAPTOP_EC_DRIVER_NAME, &platform_bus_type);
+	ec_dev = ec_drv ? driver_find_next_device(ec_drv, NULL) : NULL;
+	if (!ec_dev)
+		return dev_err_probe(dev, -EPROBE_DEFER,
+				     "waiting for EC driver %s\n",
+				     FRAMEWORK_LAPTOP_EC_DRIVER_NAME);
+
+	ret = devm_add_action_or_reset(dev, framework_put_ec, ec_dev);
+	if (ret)
+		return ret;
+
+	// Unbind us before the EC goes away, and order suspend/resume after it
+	if (!device_link_add(dev, ec_dev, DL_FLAG_AUTOREMOVE_CONSUMER))
+		dev_warn(dev, "failed to link to EC %s\n", dev_name(ec_dev));
+
+	data->ec_dev = ec_dev;
+	data->ec = dev_get_drvdata(ec_dev);
+
+	return 0;
+}
+
+// Undo what probe registered outside of devm
+static void framework_teardown(struct framework_data *data)
+{
+	mutex_lock(&fw_nl_lock);
+	if (fw_nl_data == data)
+		WRITE_ONCE(fw_nl_data, NULL);
+	mutex_unlock(&fw_nl_lock);
+
+	// Uses the hwmon and battery devices
+	cancel_delayed_work_sync(&data->event_work);
+	if (fw_has(data, FW_CAP_CHARGE_LIMIT))
+		battery_hook_unregister(&data->battery_hook);
+	blocking_notifier_chain_unregister(&data->ec->event_notifier,
+					   &data->ec_notifier);
+	debugfs_remove_recursive(data->debugfs);
+
+	// Make sure it's not null before we try to unregister it
+	if (data->hwmon_dev)
+		hwmon_device_unregister(data->hwmon_dev);
 }
 
 static int framework_probe(struct platform_device *pdev)
@@ -686,28 +3566,51 @@ static int framework_probe(struct platform_device *pdev)
 
 	dev = &pdev->dev;
 
-	ec_device = bus_find_device(&platform_bus_type, NULL, NULL, device_match_cros_ec);
-	if (!ec_device) {
-		dev_err(dev, DRV_NAME ": failed to find EC %s.\n", FRAMEWORK_LAPTOP_EC_DEVICE_NAME);
-		return -EINVAL;
-	}
-	ec_device = ec_device->parent;
-
 	data = devm_kzalloc(dev, sizeof(*data), GFP_KERNEL);
 	if (!data)
 		return -ENOMEM;
 
 	platform_set_drvdata(pdev, data);
 	data->pdev = pdev;
+	mutex_init(&data->lock);
+	data->charge_limit = -ENODATA;
+	data->charge_limit_seen = -ENODATA;
+
+	ret = framework_find_ec(data);
+	if (ret)
+		return ret;
+
+	data->stats = devm_alloc_percpu(dev, struct fw_ec_stats);
+	if (!data->stats)
+		return -ENOMEM;
 
-	data->kb_led.name = DRV_NAME "::kbd_backlight";
-	data->kb_led.brightness_get = kb_led_get;
-	data->kb_led.brightness_set_blocking = kb_led_set;
-	data->kb_led.max_brightness = 100;
-	ret = devm_led_classdev_register(&pdev->dev, &data->kb_led);
+	framework_scan_caps(data);
+
+	spin_lock_init(&data->kb_led_state_lock);
+	INIT_DELAYED_WORK(&data->kb_led_work, kb_led_work_fn);
+	INIT_WORK(&data->kb_led_sync_work, kb_led_sync_work_fn);
+	data->kb_led_last_flush = jiffies - msecs_to_jiffies(kb_led_interval_ms);
+	// Registered before the LED, so it runs after the LED core's final write
+	ret = devm_add_action_or_reset(dev, kb_led_flush, data);
 	if (ret)
 		return ret;
 
+	if (fw_has(data, FW_CAP_KB_LED_GET) && fw_has(data, FW_CAP_KB_LED_SET)) {
+		mutex_lock(&data->lock);
+		ret = ec_get_kb_led_brightness(data);
+		mutex_unlock(&data->lock);
+		data->kb_led_brightness = ret < 0 ? 0 : ret;
+
+		data->kb_led.name = DRV_NAME "::kbd_backlight";
+		data->kb_led.brightness_get = kb_led_get;
+		data->kb_led.brightness_set = kb_led_set_async;
+		data->kb_led.max_brightness = 100;
+		data->kb_led.flags = LED_BRIGHT_HW_CHANGED;
+		ret = devm_led_classdev_register(&pdev->dev, &data->kb_led);
+		if (ret)
+			return ret;
+	}
+
 #if 0
 	/* Register the driver */
 	ret = platform_driver_register(&cros_ec_lpc_driver);
@@ -724,28 +3627,78 @@ static int framework_probe(struct platform_device *pdev)
 	}
 #endif
 
-	struct cros_ec_device *ec = dev_get_drvdata(ec_device);
-	if (ec->cmd_readmem) {
-		// Count the number of fans
-		size_t fan_count;
-		if (ec_count_fans(&fan_count) < 0) {
-			dev_err(dev, DRV_NAME ": failed to count fans.\n");
+	if (fw_has(data, FW_CAP_PRIVACY)) {
+		ret = framework_privacy_init(data);
+		if (ret)
+			return ret;
+	}
+
+	ret = framework_fan_curve_init(data);
+	if (ret)
+		return ret;
+
+	ret = framework_telemetry_init(data);
+	if (ret)
+		return ret;
+
+	if (data->ec->cmd_readmem) {
+		// Count the number of fans and sensors, hwmon only exposes the
+		// detected ones
+		mutex_lock(&data->lock);
+		ret = ec_count_fans(data, &data->fan_count);
+		if (!ret)
+			ret = framework_temp_init(data);
+		mutex_unlock(&data->lock);
+		if (ret < 0) {
+			dev_err(dev, DRV_NAME ": failed to detect fans and temperature sensors.\n");
 			return -EINVAL;
 		}
-		// NULL terminates the list after the last detected fan
-		fw_hwmon_attrs[fan_count * FW_ATTRS_PER_FAN] = NULL;
 
-		data->hwmon_dev = hwmon_device_register_with_groups(
-			dev, DRV_NAME, NULL, fw_hwmon_groups);
+		ret = framework_thermal_init(data);
+		if (ret)
+			return dev_err_probe(dev, ret,
+					     "failed to register thermal devices\n");
+
+		data->hwmon_dev = hwmon_device_register_with_info(
+			dev, DRV_NAME, data, &fw_hwmon_chip_info,
+			fw_hwmon_groups);
 		if (IS_ERR(data->hwmon_dev))
 			return PTR_ERR(data->hwmon_dev);
 
 	} else {
 		dev_err(dev, DRV_NAME ": fan readings could not be enabled for this EC %s.\n",
-		FRAMEWORK_LAPTOP_EC_DEVICE_NAME);
+		dev_name(data->ec_dev));
 	}
 
-	battery_hook_register(&framework_laptop_battery_hook);
+	data->ec_notifier.notifier_call = framework_ec_notify;
+	blocking_notifier_chain_register(&data->ec->event_notifier,
+					 &data->ec_notifier);
+
+	if (fw_has(data, FW_CAP_CHARGE_LIMIT)) {
+		framework_battery_attrs_init(data);
+		data->battery_hook.add_battery = framework_laptop_battery_add;
+		data->battery_hook.remove_battery =
+			framework_laptop_battery_remove;
+		data->battery_hook.name = "Framework Laptop Battery Extension";
+		battery_hook_register(&data->battery_hook);
+	}
+
+	framework_debugfs_init(data);
+
+	INIT_DEFERRABLE_WORK(&data->event_work, framework_event_work_fn);
+	framework_events_start(data);
+
+	mutex_lock(&fw_nl_lock);
+	if (!fw_nl_data)
+		WRITE_ONCE(fw_nl_data, data);
+	mutex_unlock(&fw_nl_lock);
+	fw_nl_watch_start(data);
+
+	// Last, so that nothing can open the device before the fans and
+	// sensors it reports on are known
+	ret = framework_chardev_init(data);
+	if (ret)
+		framework_teardown(data);
 
 	return ret;
 }
@@ -760,13 +3713,8 @@ static int framework_remove(struct platform_device *pdev)
 
 	data = (struct framework_data *)platform_get_drvdata(pdev);
 
-	battery_hook_unregister(&framework_laptop_battery_hook);
-
-	// Make sure it's not null before we try to unregister it
-	if (data && data->hwmon_dev)
-		hwmon_device_unregister(data->hwmon_dev);
-
-	put_device(ec_device);
+	if (data)
+		framework_teardown(data);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 11, 0)
 	return;
@@ -780,23 +3728,29 @@ static struct platform_driver framework_driver = {
 		.name = DRV_NAME,
 		.acpi_match_table = device_ids,
 		.dev_groups = framework_laptop_groups,
+		.pm = pm_sleep_ptr(&framework_pm_ops),
+		// Never hold up boot waiting on the EC
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = framework_probe,
 	.remove = framework_remove,
 };
 
-static int __init framework_laptop_init(void)
+// Everything but the hardware check, which the fake EC build has no use for
+static int __init framework_laptop_register(void)
 {
 	int ret;
 
-	if (!dmi_check_system(framework_laptop_dmi_table)) {
-		pr_err(DRV_NAME ": unsupported system.\n");
-		return -ENODEV;
-	}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+	fw_nl_bind_time = jiffies - FW_NL_BIND_GRACE;
+#endif
+	ret = genl_register_family(&fw_genl_family);
+	if (ret)
+		goto fail;
 
 	ret = platform_driver_register(&framework_driver);
 	if (ret)
-		goto fail;
+		goto fail_genl;
 
 	fwdevice = platform_device_alloc(DRV_NAME, PLATFORM_DEVID_NONE);
 	if (!fwdevice)
@@ -818,24 +3772,49 @@ fail_device_add:
 fail_platform_driver:
 	platform_driver_unregister(&framework_driver);
 
+fail_genl:
+	genl_unregister_family(&fw_genl_family);
+
 fail:
 	return ret;
 }
 
-static void __exit framework_laptop_exit(void)
+static void __exit framework_laptop_unregister(void)
 {
 	if (fwdevice)
 	{
 		platform_device_unregister(fwdevice);
 		platform_driver_unregister(&framework_driver);
+		genl_unregister_family(&fw_genl_family);
+	}
+}
+
+static int __init __maybe_unused framework_laptop_init(void)
+{
+	if (!dmi_check_system(framework_laptop_dmi_table)) {
+		pr_err(DRV_NAME ": unsupported system.\n");
+		return -ENODEV;
 	}
+
+	return framework_laptop_register();
+}
+
+static void __exit __maybe_unused framework_laptop_exit(void)
+{
+	framework_laptop_unregister();
 }
 
+// The tests, benchmark and fake EC build carry the driver's code under their
+// own module_init
+#ifndef FRAMEWORK_LAPTOP_KUNIT
 module_init(framework_laptop_init);
 module_exit(framework_laptop_exit);
+#endif
 
+#ifndef FRAMEWORK_LAPTOP_KUNIT
 MODULE_DESCRIPTION("Framework Laptop Platform Driver");
-MODULE_AUTHOR("Dustin L. Howett <dustin@howett.net>");
-MODULE_LICENSE("GPL");
 MODULE_ALIAS("platform:" DRV_NAME);
 MODULE_SOFTDEP("pre: cros_ec_lpcs");
+#endif
+MODULE_AUTHOR("Dustin L. Howett <dustin@howett.net>");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-2.0+ WITH Linux-syscall-note */
+/*
+ * Framework Laptop ACPI Driver userspace interface
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+#ifndef _FRAMEWORK_LAPTOP_H
+#define _FRAMEWORK_LAPTOP_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define FRAMEWORK_LAPTOP_TELEMETRY_VERSION 1
+
+#define FRAMEWORK_LAPTOP_FANS 4
+#define FRAMEWORK_LAPTOP_TEMPS 16
+
+/* Values of fan_rpm[] that aren't a speed */
+#define FRAMEWORK_LAPTOP_FAN_NOT_PRESENT 0xffff
+#define FRAMEWORK_LAPTOP_FAN_STALLED 0xfffe
+
+/* privacy bits, only meaningful with FRAMEWORK_LAPTOP_PRIVACY_VALID */
+#define FRAMEWORK_LAPTOP_PRIVACY_MIC_ON (1 << 0)
+#define FRAMEWORK_LAPTOP_PRIVACY_CAMERA_ON (1 << 1)
+#define FRAMEWORK_LAPTOP_PRIVACY_VALID (1 << 7)
+
+/*
+ * Telemetry page, mapped read-only by mmap() on /dev/framework_laptop and
+ * refreshed by the driver while the device is open.
+ *
+ * seq is odd while an update is in progress. Readers copy the page and
+ * retry if seq was odd or changed in the meantime:
+ *
+ *	do {
+ *		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+ *		copy = *page;
+ *		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *	} while ((seq & 1) || seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+ */
+struct framework_laptop_telemetry {
+	__u32 seq;
+	__u32 version; /* FRAMEWORK_LAPTOP_TELEMETRY_VERSION */
+	__u64 timestamp_ns; /* CLOCK_MONOTONIC time of the last refresh */
+
+	__u16 fan_rpm[FRAMEWORK_LAPTOP_FANS];
+	__s32 temp[FRAMEWORK_LAPTOP_TEMPS]; /* millidegrees Celsius */
+	__u32 temp_valid; /* bit N set if temp[N] holds a reading */
+
+	__u8 fan_count;
+	__u8 charge_limit; /* percent, 0 if unknown */
+	__u8 kb_brightness; /* percent */
+	__u8 privacy; /* FRAMEWORK_LAPTOP_PRIVACY_* */
+	__u32 reserved[2];
+};
+
+/* Operations of FRAMEWORK_LAPTOP_IOC_BATCH */
+enum framework_laptop_op_type {
+	FRAMEWORK_LAPTOP_OP_SET_CHARGE_LIMIT = 1, /* value: percent */
+	FRAMEWORK_LAPTOP_OP_SET_FAN_DUTY, /* index: fan, value: percent */
+	FRAMEWORK_LAPTOP_OP_SET_FAN_TARGET, /* index: fan, value: RPM */
+	FRAMEWORK_LAPTOP_OP_SET_FAN_AUTO, /* index: fan */
+	FRAMEWORK_LAPTOP_OP_SET_KB_BRIGHTNESS, /* value: percent */
+	FRAMEWORK_LAPTOP_OP_READ_SNAPSHOT, /* fills the batch's snapshot */
+};
+
+struct framework_laptop_op {
+	__u32 type; /* enum framework_laptop_op_type */
+	__u32 index;
+	__u32 value;
+	__s32 result; /* set by the driver, 0 or a negative errno */
+};
+
+#define FRAMEWORK_LAPTOP_MAX_OPS 32
+
+/* Stop at the first failed operation, the rest get -ECANCELED */
+#define FRAMEWORK_LAPTOP_BATCH_STOP_ON_ERROR (1 << 0)
+
+struct framework_laptop_batch {
+	__u32 count; /* number of entries used in ops */
+	__u32 flags; /* FRAMEWORK_LAPTOP_BATCH_* */
+	struct framework_laptop_op ops[FRAMEWORK_LAPTOP_MAX_OPS];
+	struct framework_laptop_telemetry snapshot;
+};
+
+#define FRAMEWORK_LAPTOP_IOC_MAGIC 0xFB
+
+/*
+ * Run a batch of operations in order, without any other EC access in
+ * between. Setting operations need the device to be open for writing.
+ * Returns 0 once the batch ran, with each operation's outcome in its result.
+ */
+#define FRAMEWORK_LAPTOP_IOC_BATCH \
+	_IOWR(FRAMEWORK_LAPTOP_IOC_MAGIC, 0x01, struct framework_laptop_batch)
+
+/*
+ * Generic netlink family. Members of the telemetry multicast group receive a
+ * FRAMEWORK_LAPTOP_CMD_TELEMETRY message whenever a sample differs from the
+ * previous one, carrying only what changed. FRAMEWORK_LAPTOP_CMD_GET replies
+ * with the full current state in the same format.
+ */
+#define FRAMEWORK_LAPTOP_GENL_NAME "framework_laptop"
+#define FRAMEWORK_LAPTOP_GENL_VERSION 1
+#define FRAMEWORK_LAPTOP_GENL_MCGRP_TELEMETRY "telemetry"
+
+enum framework_laptop_genl_cmd {
+	FRAMEWORK_LAPTOP_CMD_UNSPEC,
+	FRAMEWORK_LAPTOP_CMD_GET,
+	FRAMEWORK_LAPTOP_CMD_TELEMETRY,
+	__FRAMEWORK_LAPTOP_CMD_MAX
+};
+
+#define FRAMEWORK_LAPTOP_CMD_MAX (__FRAMEWORK_LAPTOP_CMD_MAX - 1)
+
+enum framework_laptop_genl_attr {
+	FRAMEWORK_LAPTOP_ATTR_UNSPEC,
+	FRAMEWORK_LAPTOP_ATTR_PAD,
+	FRAMEWORK_LAPTOP_ATTR_TIMESTAMP, /* u64, CLOCK_MONOTONIC ns */
+	FRAMEWORK_LAPTOP_ATTR_FAN, /* nested INDEX and VALUE, one per fan */
+	FRAMEWORK_LAPTOP_ATTR_TEMP, /* nested INDEX and VALUE, one per sensor */
+	FRAMEWORK_LAPTOP_ATTR_CHARGE_LIMIT, /* u8, percent, 0 if unknown */
+	FRAMEWORK_LAPTOP_ATTR_PRIVACY, /* u8, FRAMEWORK_LAPTOP_PRIVACY_* */
+	FRAMEWORK_LAPTOP_ATTR_INDEX, /* u8 */
+	/*
+	 * u32 fan_rpm value for fans, s32 millidegrees Celsius for sensors.
+	 * A sensor without VALUE has no reading.
+	 */
+	FRAMEWORK_LAPTOP_ATTR_VALUE,
+	__FRAMEWORK_LAPTOP_ATTR_MAX
+};
+
+#define FRAMEWORK_LAPTOP_ATTR_MAX (__FRAMEWORK_LAPTOP_ATTR_MAX - 1)
+
+#endif /* _FRAMEWORK_LAPTOP_H */
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Framework Laptop ACPI Driver benchmark
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+// Built like the KUnit tests, with the driver's code running against a fake
+// EC whose commands take a set amount of time
+#define FRAMEWORK_LAPTOP_KUNIT
+#define FRAMEWORK_LAPTOP_BENCH
+#include "framework_laptop.c"
+#include "framework_laptop_fake_ec.h"
+
+#include <linux/kthread.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+
+static char *bench_attr;
+module_param_named(attr, bench_attr, charp, 0444);
+MODULE_PARM_DESC(attr, "Attribute to benchmark, all of them if unset");
+
+static unsigned int threads = 4;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "Threads hammering the attribute at once");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "How long each attribute is benchmarked");
+
+static unsigned int write_pct;
+module_param(write_pct, uint, 0444);
+MODULE_PARM_DESC(write_pct,
+		 "Percentage of operations that store rather than show");
+
+static unsigned int ec_latency_us = 150;
+module_param(ec_latency_us, uint, 0444);
+MODULE_PARM_DESC(ec_latency_us, "Time the fake EC takes for each command");
+
+static unsigned int readmem_latency_us = 5;
+module_param(readmem_latency_us, uint, 0444);
+MODULE_PARM_DESC(readmem_latency_us,
+		 "Time the fake EC takes for each memmap read");
+
+static unsigned int max_samples = 100000;
+module_param(max_samples, uint, 0444);
+MODULE_PARM_DESC(max_samples,
+		 "Latencies kept per thread for the percentiles");
+
+struct fw_bench_thread;
+
+struct fw_bench_attr {
+	const char *name;
+	// Show when !write, store otherwise
+	int (*op)(struct fw_bench_thread *t, bool write);
+};
+
+struct fw_bench_thread {
+	struct framework_data *data;
+	const struct fw_bench_attr *attr;
+	struct completion done;
+	char *page; // sysfs buffers are a page
+	u64 *samples;
+	unsigned int nr_samples;
+	u64 ops;
+	u64 errors;
+};
+
+static DECLARE_COMPLETION(fw_bench_start);
+static u64 fw_bench_deadline;
+
+// --- attributes ---
+// Each goes through the same callbacks as its sysfs file
+
+static int fw_bench_fan1_input(struct fw_bench_thread *t, bool write)
+{
+	long val;
+
+	// Read-only
+	return fw_hwmon_read(&t->data->pdev->dev, hwmon_fan, hwmon_fan_input,
+			     0, &val);
+}
+
+static int fw_bench_charge_limit(struct fw_bench_thread *t, bool write)
+{
+	struct device_attribute *attr = &t->data->charge_attr;
+	ssize_t ret;
+
+	if (!write)
+		ret = charge_control_end_threshold_show(NULL, attr, t->page);
+	else if (t->ops & 1)
+		ret = charge_control_end_threshold_store(NULL, attr, "80\n", 3);
+	else
+		ret = charge_control_end_threshold_store(NULL, attr, "90\n", 3);
+
+	return ret < 0 ? ret : 0;
+}
+
+// The LED core's brightness show and store
+static int fw_bench_brightness(struct fw_bench_thread *t, bool write)
+{
+	struct led_classdev *led = &t->data->kb_led;
+
+	if (write)
+		led_set_brightness(led, t->ops & 1 ? 20 : 80);
+	else
+		led_update_brightness(led);
+
+	return 0;
+}
+
+static const struct fw_bench_attr fw_bench_attrs[] = {
+	{ "fan1_input", fw_bench_fan1_input },
+	{ "charge_control_end_threshold", fw_bench_charge_limit },
+	{ "brightness", fw_bench_brightness },
+};
+
+// --- runner ---
+
+static int fw_bench_thread_fn(void *arg)
+{
+	struct fw_bench_thread *t = arg;
+
+	wait_for_completion(&fw_bench_start);
+
+	while (ktime_get_ns() < READ_ONCE(fw_bench_deadline)) {
+		// Spread the stores evenly over the run
+		bool write = (t->ops + 1) * write_pct / 100 !=
+			     t->ops * write_pct / 100;
+		u64 start = ktime_get_ns();
+		int ret;
+
+		ret = t->attr->op(t, write);
+
+		if (t->nr_samples < max_samples)
+			t->samples[t->nr_samples++] = ktime_get_ns() - start;
+		if (ret < 0)
+			t->errors++;
+		t->ops++;
+
+		cond_resched();
+	}
+
+	complete(&t->done);
+
+	return 0;
+}
+
+static int fw_bench_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void fw_bench_report(const struct fw_bench_attr *attr,
+			    struct fw_fake_ec *fake,
+			    struct fw_bench_thread *t, u64 elapsed_ns)
+{
+	u64 ops = 0, errors = 0, commands, reads;
+	unsigned int n = 0;
+	u64 *samples;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		ops += t[i].ops;
+		errors += t[i].errors;
+		n += t[i].nr_samples;
+	}
+
+	if (!ops || !n) {
+		pr_info(DRV_NAME "_bench: %s: no operations completed\n",
+			attr->name);
+		return;
+	}
+
+	samples = vmalloc_array(n, sizeof(*samples));
+	if (!samples)
+		return;
+
+	n = 0;
+	for (unsigned int i = 0; i < threads; i++) {
+		memcpy(&samples[n], t[i].samples,
+		       t[i].nr_samples * sizeof(*samples));
+		n += t[i].nr_samples;
+	}
+	sort(samples, n, sizeof(*samples), fw_bench_cmp, NULL);
+
+	// Hundredths of a command per operation
+	commands = div64_u64(atomic_read(&fake->xfers) * 100ULL, ops);
+	reads = div64_u64(atomic_read(&fake->readmems) * 100ULL, ops);
+
+	pr_info(DRV_NAME
+		"_bench: %s: %u threads, %u%% writes: %llu ops/s, p50 %llu ns, p99 %llu ns, %llu.%02llu EC commands/op, %llu.%02llu memmap reads/op, %llu errors\n",
+		attr->name, threads, write_pct,
+		div64_u64(ops * NSEC_PER_SEC, elapsed_ns), samples[n / 2],
+		samples[min(n - 1, (unsigned int)div_u64(n * 99ULL, 100))],
+		commands / 100, commands % 100, reads / 100, reads % 100,
+		errors);
+
+	vfree(samples);
+}
+
+static int fw_bench_run(const struct fw_bench_attr *attr)
+{
+	struct fw_bench_thread *t;
+	struct fw_fake_env *env;
+	u64 start, elapsed;
+	int ret;
+
+	env = kzalloc(sizeof(*env), GFP_KERNEL);
+	t = kcalloc(threads, sizeof(*t), GFP_KERNEL);
+	if (!env || !t) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = fw_fake_env_init(env);
+	if (ret)
+		goto out;
+
+	env->fake.latency_us = ec_latency_us;
+	env->fake.readmem_latency_us = readmem_latency_us;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		t[i].data = &env->data;
+		t[i].attr = attr;
+		init_completion(&t[i].done);
+		t[i].page = (char *)__get_free_page(GFP_KERNEL);
+		t[i].samples = vmalloc_array(max_samples, sizeof(u64));
+		if (!t[i].page || !t[i].samples) {
+			ret = -ENOMEM;
+			goto out_threads;
+		}
+	}
+
+	reinit_completion(&fw_bench_start);
+	for (unsigned int i = 0; i < threads; i++) {
+		struct task_struct *task;
+
+		task = kthread_run(fw_bench_thread_fn, &t[i],
+				   DRV_NAME "_bench/%u", i);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			// Let the ones already started run out straight away
+			WRITE_ONCE(fw_bench_deadline, 0);
+			complete_all(&fw_bench_start);
+			for (unsigned int j = 0; j < i; j++)
+				wait_for_completion(&t[j].done);
+			goto out_threads;
+		}
+	}
+
+	start = ktime_get_ns();
+	WRITE_ONCE(fw_bench_deadline, start + (u64)duration_ms * NSEC_PER_MSEC);
+	complete_all(&fw_bench_start);
+
+	for (unsigned int i = 0; i < threads; i++)
+		wait_for_completion(&t[i].done);
+	elapsed = ktime_get_ns() - start;
+
+	// Coalesced writes still queued count towards the run
+	flush_delayed_work(&env->data.kb_led_work);
+
+	fw_bench_report(attr, &env->fake, t, elapsed);
+
+out_threads:
+	for (unsigned int i = 0; i < threads; i++) {
+		vfree(t[i].samples);
+		free_page((unsigned long)t[i].page);
+	}
+	fw_fake_env_destroy(env);
+out:
+	kfree(t);
+	kfree(env);
+	return ret;
+}
+
+static int __init framework_laptop_bench_init(void)
+{
+	bool found = false;
+	int ret;
+
+	if (!threads || !max_samples)
+		return -EINVAL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(fw_bench_attrs); i++) {
+		if (bench_attr && strcmp(bench_attr, fw_bench_attrs[i].name))
+			continue;
+
+		found = true;
+		ret = fw_bench_run(&fw_bench_attrs[i]);
+		if (ret)
+			return ret;
+	}
+
+	return found ? 0 : -EINVAL;
+}
+
+static void __exit framework_laptop_bench_exit(void)
+{
+}
+
+module_init(framework_laptop_bench_init);
+module_exit(framework_laptop_bench_exit);
+
+MODULE_DESCRIPTION("Framework Laptop Platform Driver benchmark");
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Framework Laptop ACPI Driver on a fake EC
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+// The complete driver, sysfs and all, bound to the fake EC from the tests in
+// place of cros_ec_lpcs. For exercising the driver's interfaces in a VM.
+#define FRAMEWORK_LAPTOP_KUNIT
+#define FRAMEWORK_LAPTOP_FAKE
+#include "framework_laptop.c"
+#include "framework_laptop_fake_ec.h"
+
+static unsigned int ec_latency_us = 150;
+module_param(ec_latency_us, uint, 0444);
+MODULE_PARM_DESC(ec_latency_us, "Time the fake EC takes for each command");
+
+static unsigned int readmem_latency_us = 5;
+module_param(readmem_latency_us, uint, 0444);
+MODULE_PARM_DESC(readmem_latency_us,
+		 "Time the fake EC takes for each memmap read");
+
+static struct fw_fake_ec *fw_fake;
+static struct platform_device *fw_fake_ec_pdev;
+
+// Bound like cros_ec_lpcs would be, framework_find_ec() looks the EC up
+// through this driver
+static int fw_fake_ec_probe(struct platform_device *pdev)
+{
+	platform_set_drvdata(pdev, &fw_fake->ec);
+
+	return 0;
+}
+
+static struct platform_driver fw_fake_ec_driver = {
+	.driver = {
+		.name = FRAMEWORK_LAPTOP_EC_DRIVER_NAME,
+	},
+	.probe = fw_fake_ec_probe,
+};
+
+static int __init framework_laptop_fake_init(void)
+{
+	int ret;
+
+	fw_fake = kzalloc(sizeof(*fw_fake), GFP_KERNEL);
+	if (!fw_fake)
+		return -ENOMEM;
+
+	ret = platform_driver_register(&fw_fake_ec_driver);
+	if (ret)
+		goto fail;
+
+	fw_fake_ec_pdev = platform_device_alloc(FRAMEWORK_LAPTOP_EC_DRIVER_NAME,
+						PLATFORM_DEVID_NONE);
+	if (!fw_fake_ec_pdev) {
+		ret = -ENOMEM;
+		goto fail_driver;
+	}
+
+	fw_fake_ec_init(fw_fake, &fw_fake_ec_pdev->dev);
+	fw_fake->latency_us = ec_latency_us;
+	fw_fake->readmem_latency_us = readmem_latency_us;
+
+	ret = platform_device_add(fw_fake_ec_pdev);
+	if (ret) {
+		platform_device_put(fw_fake_ec_pdev);
+		goto fail_driver;
+	}
+
+	ret = framework_laptop_register();
+	if (ret)
+		goto fail_ec;
+
+	return 0;
+
+fail_ec:
+	platform_device_unregister(fw_fake_ec_pdev);
+fail_driver:
+	platform_driver_unregister(&fw_fake_ec_driver);
+fail:
+	kfree(fw_fake);
+	return ret;
+}
+
+static void __exit framework_laptop_fake_exit(void)
+{
+	framework_laptop_unregister();
+	platform_device_unregister(fw_fake_ec_pdev);
+	platform_driver_unregister(&fw_fake_ec_driver);
+	kfree(fw_fake);
+}
+
+module_init(framework_laptop_fake_init);
+module_exit(framework_laptop_fake_exit);
+
+MODULE_DESCRIPTION("Framework Laptop Platform Driver on a fake EC");
@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Framework Laptop ACPI Driver fake EC, for the tests and benchmarks
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+#ifndef _FRAMEWORK_LAPTOP_FAKE_EC_H
+#define _FRAMEWORK_LAPTOP_FAKE_EC_H
+
+// Only usable from a module that includes framework_laptop.c
+#ifndef FRAMEWORK_LAPTOP_KUNIT
+#error "framework_laptop_fake_ec.h needs FRAMEWORK_LAPTOP_KUNIT"
+#endif
+
+#include <linux/delay.h>
+
+// Stands in for cros_ec_lpcs. Commands go through the real cros_ec_proto
+// code, so result codes are mapped to errors exactly as on hardware.
+struct fw_fake_ec {
+	struct cros_ec_device ec;
+
+	// Injected behaviour, set before use
+	unsigned int latency_us; // added to every command
+	unsigned int readmem_latency_us; // added to every memmap read
+	u16 unsupported; // command the EC doesn't know, 0 for none
+	bool fan_v0_only; // fan commands without a fan index
+	u16 fail_command; // answered with fail_result, 0 for none
+	u32 fail_result; // EC_RES_*
+	int xfer_error; // transport error for every command, 0 for none
+	int readmem_error; // error for every memmap read, 0 for none
+
+	// EC state, commands update it under ec.lock
+	u8 memmap[EC_MEMMAP_SIZE];
+	u8 charge_limit;
+	u8 kb_percent;
+	u32 fan_duty[EC_FAN_SPEED_ENTRIES];
+	u32 fan_target[EC_FAN_SPEED_ENTRIES];
+	bool fan_auto[EC_FAN_SPEED_ENTRIES];
+	u32 last_version; // of the last command
+	struct ec_response_privacy_switches_check privacy;
+
+	// Calls seen, commands per fw_ec_stat_slot()
+	atomic_t xfers;
+	atomic_t readmems;
+	atomic_t commands[FW_EC_STAT_SLOTS];
+};
+
+static u32 fw_fake_ec_versions(struct fw_fake_ec *fake, u16 command)
+{
+	if (command == fake->unsupported)
+		return 0;
+
+	switch (command) {
+	case EC_CMD_GET_CMD_VERSIONS:
+		return EC_VER_MASK(0) | EC_VER_MASK(1);
+	case EC_CMD_PWM_SET_FAN_TARGET_RPM:
+	case EC_CMD_THERMAL_AUTO_FAN_CTRL:
+	case EC_CMD_PWM_SET_FAN_DUTY:
+		return EC_VER_MASK(0) |
+		       (fake->fan_v0_only ? 0 : EC_VER_MASK(1));
+	case EC_CMD_THERMAL_GET_THRESHOLD:
+		return EC_VER_MASK(1);
+	case EC_CMD_CHARGE_LIMIT_CONTROL:
+	case EC_CMD_PWM_GET_DUTY:
+	case EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT:
+	case EC_CMD_PWM_GET_FAN_TARGET_RPM:
+	case EC_CMD_PRIVACY_SWITCHES_CHECK_MODE:
+	case EC_CMD_TEMP_SENSOR_GET_INFO:
+		return EC_VER_MASK(0);
+	default:
+		return 0;
+	}
+}
+
+// Fan commands at version 0 apply to every fan
+static void fw_fake_ec_set_fans(struct fw_fake_ec *fake, u32 *field,
+				const u8 *params, u32 version, u32 value)
+{
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++) {
+		if (version && i != params[sizeof(u32)])
+			continue;
+
+		field[i] = value;
+		fake->fan_auto[i] = false;
+	}
+}
+
+// Parameters and response share msg->data, so the parameters are consumed
+// before the response is written
+static u32 fw_fake_ec_run(struct fw_fake_ec *fake, struct cros_ec_command *msg)
+{
+	u8 *buf = msg->data;
+	u32 value;
+
+	switch (msg->command) {
+	case EC_CMD_GET_CMD_VERSIONS: {
+		struct ec_params_get_cmd_versions_v1 *p = (void *)buf;
+		struct ec_response_get_cmd_versions *r = (void *)buf;
+		u32 mask = fw_fake_ec_versions(fake, p->cmd);
+
+		if (!mask)
+			return EC_RES_INVALID_PARAM;
+		r->version_mask = mask;
+		break;
+	}
+	case EC_CMD_CHARGE_LIMIT_CONTROL: {
+		struct ec_params_ec_chg_limit_control *p = (void *)buf;
+		struct ec_response_chg_limit_control *r = (void *)buf;
+
+		if (p->modes & CHG_LIMIT_SET_LIMIT)
+			fake->charge_limit = p->max_percentage;
+		r->max_percentage = fake->charge_limit;
+		r->min_percentage = 0;
+		break;
+	}
+	case EC_CMD_PWM_GET_DUTY: {
+		struct ec_response_pwm_get_duty *r = (void *)buf;
+
+		r->duty = DIV_ROUND_UP(fake->kb_percent * EC_PWM_MAX_DUTY, 100);
+		break;
+	}
+	case EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT:
+		fake->kb_percent =
+			((struct ec_params_pwm_set_keyboard_backlight *)buf)
+				->percent;
+		break;
+	case EC_CMD_PWM_SET_FAN_DUTY:
+		memcpy(&value, buf, sizeof(value));
+		fw_fake_ec_set_fans(fake, fake->fan_duty, buf, msg->version,
+				    value);
+		break;
+	case EC_CMD_PWM_SET_FAN_TARGET_RPM:
+		memcpy(&value, buf, sizeof(value));
+		fw_fake_ec_set_fans(fake, fake->fan_target, buf, msg->version,
+				    value);
+		break;
+	case EC_CMD_PWM_GET_FAN_TARGET_RPM:
+		memcpy(buf, &fake->fan_target[0], sizeof(u32));
+		break;
+	case EC_CMD_THERMAL_AUTO_FAN_CTRL:
+		for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++) {
+			if (!msg->version || i == buf[0])
+				fake->fan_auto[i] = true;
+		}
+		break;
+	case EC_CMD_PRIVACY_SWITCHES_CHECK_MODE:
+		memcpy(buf, &fake->privacy, sizeof(fake->privacy));
+		break;
+	case EC_CMD_TEMP_SENSOR_GET_INFO: {
+		struct ec_response_temp_sensor_get_info *r = (void *)buf;
+		u8 id = buf[0];
+
+		memset(r, 0, sizeof(*r));
+		snprintf(r->sensor_name, sizeof(r->sensor_name), "fake%u", id);
+		break;
+	}
+	case EC_CMD_THERMAL_GET_THRESHOLD:
+		// No fan thresholds, so thermal zones only report temperatures
+		memset(buf, 0, msg->insize);
+		break;
+	}
+
+	return EC_RES_SUCCESS;
+}
+
+// Called by cros_ec_cmd_xfer() with ec.lock held
+static int fw_fake_ec_xfer(struct cros_ec_device *ec,
+			   struct cros_ec_command *msg)
+{
+	struct fw_fake_ec *fake = container_of(ec, struct fw_fake_ec, ec);
+	u32 versions = fw_fake_ec_versions(fake, msg->command);
+
+	atomic_inc(&fake->xfers);
+	atomic_inc(&fake->commands[fw_ec_stat_slot(msg->command)]);
+
+	if (fake->latency_us)
+		fsleep(fake->latency_us);
+	if (fake->xfer_error)
+		return fake->xfer_error;
+
+	fake->last_version = msg->version;
+
+	if (!versions)
+		msg->result = EC_RES_INVALID_COMMAND;
+	else if (!(versions & EC_VER_MASK(msg->version)))
+		msg->result = EC_RES_INVALID_VERSION;
+	else if (fake->fail_command && msg->command == fake->fail_command)
+		msg->result = fake->fail_result;
+	else
+		msg->result = fw_fake_ec_run(fake, msg);
+
+	return msg->result == EC_RES_SUCCESS ? msg->insize : 0;
+}
+
+static int fw_fake_ec_readmem(struct cros_ec_device *ec, unsigned int offset,
+			      unsigned int bytes, void *dest)
+{
+	struct fw_fake_ec *fake = container_of(ec, struct fw_fake_ec, ec);
+
+	atomic_inc(&fake->readmems);
+
+	if (fake->readmem_latency_us)
+		fsleep(fake->readmem_latency_us);
+	if (fake->readmem_error)
+		return fake->readmem_error;
+	if (offset + bytes > EC_MEMMAP_SIZE)
+		return -EINVAL;
+
+	memcpy(dest, &fake->memmap[offset], bytes);
+
+	return bytes;
+}
+
+static inline void fw_fake_ec_set_fan(struct fw_fake_ec *fake, size_t idx,
+				      u16 rpm)
+{
+	memcpy(&fake->memmap[EC_MEMMAP_FAN + idx * sizeof(rpm)], &rpm,
+	       sizeof(rpm));
+}
+
+static inline void fw_fake_ec_set_temp(struct fw_fake_ec *fake, size_t idx,
+				       u8 temp)
+{
+	fake->memmap[EC_MEMMAP_TEMP_SENSOR + idx] = temp;
+}
+
+static inline unsigned int fw_fake_ec_commands(struct fw_fake_ec *fake,
+						u16 command)
+{
+	return atomic_read(&fake->commands[fw_ec_stat_slot(command)]);
+}
+
+static inline void fw_fake_ec_reset_counts(struct fw_fake_ec *fake)
+{
+	atomic_set(&fake->xfers, 0);
+	atomic_set(&fake->readmems, 0);
+	for (size_t i = 0; i < FW_EC_STAT_SLOTS; i++)
+		atomic_set(&fake->commands[i], 0);
+}
+
+// One fan at 2000 RPM and one sensor at 300K, like an idle laptop
+static inline void fw_fake_ec_init(struct fw_fake_ec *fake, struct device *dev)
+{
+	memset(fake, 0, sizeof(*fake));
+
+	fake->ec.dev = dev;
+	fake->ec.cmd_xfer = fw_fake_ec_xfer;
+	fake->ec.cmd_readmem = fw_fake_ec_readmem;
+	// Protocol v2 goes through cmd_xfer, later ones through pkt_xfer
+	fake->ec.proto_version = 2;
+	fake->ec.max_request = 0x100;
+	fake->ec.max_response = 0x100;
+	mutex_init(&fake->ec.lock);
+	BLOCKING_INIT_NOTIFIER_HEAD(&fake->ec.event_notifier);
+
+	memset(&fake->memmap[EC_MEMMAP_TEMP_SENSOR], EC_TEMP_SENSOR_NOT_PRESENT,
+	       EC_TEMP_SENSOR_ENTRIES);
+	fw_fake_ec_set_temp(fake, 0, 300 - EC_TEMP_SENSOR_OFFSET);
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++)
+		fw_fake_ec_set_fan(fake, i, EC_FAN_SPEED_NOT_PRESENT);
+	fw_fake_ec_set_fan(fake, 0, 2000);
+
+	fake->charge_limit = 100;
+	fake->kb_percent = 50;
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++)
+		fake->fan_auto[i] = true;
+}
+
+// A device backed by a fake EC, wired up like probe does minus sysfs and
+// hwmon, though the hwmon callbacks work on the platform device. Only the
+// keyboard LED is registered, so hardware changes to it can be reported.
+struct fw_fake_env {
+	struct fw_fake_ec fake;
+	struct framework_data data;
+	struct framework_laptop_telemetry telemetry;
+	struct platform_device *pdev;
+};
+
+static inline int fw_fake_env_init(struct fw_fake_env *env)
+{
+	struct framework_data *data = &env->data;
+	int ret;
+
+	env->pdev = platform_device_register_simple(
+		DRV_NAME "_fake", PLATFORM_DEVID_AUTO, NULL, 0);
+	if (IS_ERR(env->pdev))
+		return PTR_ERR(env->pdev);
+
+	fw_fake_ec_init(&env->fake, &env->pdev->dev);
+
+	platform_set_drvdata(env->pdev, data);
+	data->pdev = env->pdev;
+	data->ec = &env->fake.ec;
+	data->telemetry = &env->telemetry;
+	mutex_init(&data->lock);
+	data->charge_limit = -ENODATA;
+	data->charge_limit_seen = -ENODATA;
+
+	data->stats = alloc_percpu(struct fw_ec_stats);
+	if (!data->stats) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	framework_scan_caps(data);
+
+	mutex_lock(&data->lock);
+	ret = ec_count_fans(data, &data->fan_count);
+	if (!ret)
+		ret = ec_get_kb_led_brightness(data);
+	mutex_unlock(&data->lock);
+	if (ret < 0)
+		goto fail_stats;
+	data->kb_led_brightness = ret;
+
+	spin_lock_init(&data->kb_led_state_lock);
+	INIT_DELAYED_WORK(&data->kb_led_work, kb_led_work_fn);
+	INIT_WORK(&data->kb_led_sync_work, kb_led_sync_work_fn);
+	data->kb_led_last_flush = jiffies - msecs_to_jiffies(kb_led_interval_ms);
+
+	data->kb_led.name = DRV_NAME "_fake::kbd_backlight";
+	data->kb_led.brightness_get = kb_led_get;
+	data->kb_led.brightness_set = kb_led_set_async;
+	data->kb_led.max_brightness = 100;
+	data->kb_led.flags = LED_BRIGHT_HW_CHANGED;
+	ret = led_classdev_register(&env->pdev->dev, &data->kb_led);
+	if (ret)
+		goto fail_stats;
+
+	// Setting up isn't what is being measured
+	fw_fake_ec_reset_counts(&env->fake);
+	memset(&data->memmap, 0, sizeof(data->memmap));
+
+	return 0;
+
+fail_stats:
+	free_percpu(data->stats);
+fail:
+	platform_device_unregister(env->pdev);
+	return ret;
+}
+
+static inline void fw_fake_env_destroy(struct fw_fake_env *env)
+{
+	// The LED core turns the LED off on the way out, let that flush
+	led_classdev_unregister(&env->data.kb_led);
+	kb_led_flush(&env->data);
+
+	free_percpu(env->data.stats);
+	platform_device_unregister(env->pdev);
+}
+
+#endif /* _FRAMEWORK_LAPTOP_FAKE_EC_H */
@@ -0,0 +1,755 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Framework Laptop ACPI Driver KUnit tests
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+// The driver is built into the tests, so its static helpers can be called
+// directly against a fake EC
+#define FRAMEWORK_LAPTOP_KUNIT
+#include "framework_laptop.c"
+#include "framework_laptop_fake_ec.h"
+
+#include <kunit/test.h>
+
+struct fw_test {
+	struct fw_fake_env env;
+	// Module parameters the tests change, put back afterwards
+	unsigned int memmap_cache_ms;
+	unsigned int kb_led_interval_ms;
+	unsigned int fan_stall_debounce;
+	bool fan_force_write;
+};
+
+static int fw_test_init(struct kunit *test)
+{
+	struct fw_test *t;
+	int ret;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+
+	t->memmap_cache_ms = memmap_cache_ms;
+	t->kb_led_interval_ms = kb_led_interval_ms;
+	t->fan_stall_debounce = fan_stall_debounce;
+	t->fan_force_write = fan_force_write;
+
+	ret = fw_fake_env_init(&t->env);
+	if (ret) {
+		kfree(t);
+		return ret;
+	}
+
+	test->priv = t;
+	return 0;
+}
+
+static void fw_test_exit(struct kunit *test)
+{
+	struct fw_test *t = test->priv;
+
+	fw_fake_env_destroy(&t->env);
+
+	memmap_cache_ms = t->memmap_cache_ms;
+	kb_led_interval_ms = t->kb_led_interval_ms;
+	fan_stall_debounce = t->fan_stall_debounce;
+	fan_force_write = t->fan_force_write;
+
+	kfree(t);
+}
+
+static struct fw_fake_ec *fw_test_ec(struct kunit *test)
+{
+	return &((struct fw_test *)test->priv)->env.fake;
+}
+
+static struct framework_data *fw_test_data(struct kunit *test)
+{
+	return &((struct fw_test *)test->priv)->env.data;
+}
+
+static struct fw_ec_cmd_stats fw_test_stats(struct framework_data *data,
+					    u16 command)
+{
+	unsigned int slot = fw_ec_stat_slot(command);
+	struct fw_ec_cmd_stats sum = {};
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fw_ec_cmd_stats *s =
+			&per_cpu_ptr(data->stats, cpu)->cmd[slot];
+
+		sum.calls += s->calls;
+		sum.errors += s->errors;
+		sum.max_ns = max(sum.max_ns, s->max_ns);
+	}
+
+	return sum;
+}
+
+// --- EC capabilities ---
+
+static void fw_test_caps_query_once(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	bitmap_zero(data->caps, FW_CAP_COUNT);
+	framework_scan_caps(data);
+
+	// GET_CMD_VERSIONS itself, then each distinct command of fw_caps[]
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->xfers), 11);
+	KUNIT_EXPECT_TRUE(test, bitmap_full(data->caps, FW_CAP_COUNT));
+}
+
+static void fw_test_caps_unsupported(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fake->unsupported = EC_CMD_PRIVACY_SWITCHES_CHECK_MODE;
+	fake->fan_v0_only = true;
+	bitmap_zero(data->caps, FW_CAP_COUNT);
+	framework_scan_caps(data);
+
+	KUNIT_EXPECT_FALSE(test, fw_has(data, FW_CAP_PRIVACY));
+	KUNIT_EXPECT_TRUE(test, fw_has(data, FW_CAP_CHARGE_LIMIT));
+	KUNIT_EXPECT_TRUE(test, fw_has(data, FW_CAP_FAN_DUTY_V0));
+	KUNIT_EXPECT_FALSE(test, fw_has(data, FW_CAP_FAN_DUTY_V1));
+}
+
+static void fw_test_caps_old_ec(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fake->unsupported = EC_CMD_GET_CMD_VERSIONS;
+	bitmap_zero(data->caps, FW_CAP_COUNT);
+	framework_scan_caps(data);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->xfers), 1);
+	KUNIT_EXPECT_TRUE(test, bitmap_full(data->caps, FW_CAP_COUNT));
+}
+
+// Version 0 fan commands are only good enough with a single fan
+static void fw_test_fan_cmd_v0(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fake->fan_v0_only = true;
+	bitmap_zero(data->caps, FW_CAP_COUNT);
+	framework_scan_caps(data);
+
+	data->fan_count = 1;
+	KUNIT_ASSERT_TRUE(test, fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0,
+					       FW_CAP_FAN_DUTY_V1));
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 40), 0);
+	mutex_unlock(&data->lock);
+	KUNIT_EXPECT_EQ(test, fake->last_version, 0);
+	KUNIT_EXPECT_EQ(test, fake->fan_duty[0], 40);
+
+	data->fan_count = 2;
+	KUNIT_EXPECT_FALSE(test, fw_has_fan_cmd(data, FW_CAP_FAN_DUTY_V0,
+						FW_CAP_FAN_DUTY_V1));
+}
+
+// --- charge limit ---
+
+static void fw_test_charge_limit_cached(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fake->charge_limit = 87;
+
+	for (int i = 0; i < 10; i++)
+		KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 87);
+
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_CHARGE_LIMIT_CONTROL),
+			1);
+
+	// Dropping the cache costs exactly one more query
+	framework_invalidate_cache(data);
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 87);
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 87);
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_CHARGE_LIMIT_CONTROL),
+			2);
+}
+
+static void fw_test_charge_limit_write_through(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	KUNIT_EXPECT_EQ(test, framework_set_charge_limit(data, 60), 0);
+	KUNIT_EXPECT_EQ(test, fake->charge_limit, 60);
+
+	// The write is all the EC has to see
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 60);
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_CHARGE_LIMIT_CONTROL),
+			1);
+}
+
+static void fw_test_charge_limit_error(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct fw_ec_cmd_stats stats;
+
+	fake->fail_command = EC_CMD_CHARGE_LIMIT_CONTROL;
+	fake->fail_result = EC_RES_ACCESS_DENIED;
+	KUNIT_EXPECT_EQ(test, framework_set_charge_limit(data, 60), -EIO);
+
+	fake->fail_command = 0;
+	fake->xfer_error = -ETIMEDOUT;
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), -EIO);
+
+	stats = fw_test_stats(data, EC_CMD_CHARGE_LIMIT_CONTROL);
+	KUNIT_EXPECT_EQ(test, stats.calls, 2);
+	KUNIT_EXPECT_EQ(test, stats.errors, 2);
+
+	// Errors are never cached
+	fake->xfer_error = 0;
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 100);
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_CHARGE_LIMIT_CONTROL),
+			3);
+}
+
+// --- instrumentation ---
+
+static void fw_test_latency_recorded(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct fw_ec_cmd_stats stats;
+
+	fake->latency_us = 2000;
+	KUNIT_EXPECT_EQ(test, framework_get_charge_limit(data), 100);
+
+	stats = fw_test_stats(data, EC_CMD_CHARGE_LIMIT_CONTROL);
+	KUNIT_EXPECT_EQ(test, stats.calls, 1);
+	KUNIT_EXPECT_EQ(test, stats.errors, 0);
+	KUNIT_EXPECT_GE(test, stats.max_ns, 2000 * NSEC_PER_USEC);
+}
+
+// --- memmap snapshot ---
+
+static void fw_test_memmap_cached(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct fw_memmap_snapshot snap;
+
+	// Long enough that the test can't outlive it
+	memmap_cache_ms = 60000;
+
+	mutex_lock(&data->lock);
+	for (int i = 0; i < 10; i++) {
+		KUNIT_EXPECT_EQ(test, ec_read_memmap_snapshot(data, &snap), 0);
+		KUNIT_EXPECT_EQ(test, snap.fans[0], 2000);
+		KUNIT_EXPECT_EQ(test, snap.temps[0], 100);
+	}
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->readmems), 1);
+	KUNIT_EXPECT_EQ(test, data->memmap.reads, 1);
+	KUNIT_EXPECT_EQ(test, data->memmap.hits, 9);
+}
+
+static void fw_test_memmap_uncached(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct fw_memmap_snapshot snap;
+
+	memmap_cache_ms = 0;
+
+	mutex_lock(&data->lock);
+	for (int i = 0; i < 10; i++)
+		KUNIT_EXPECT_EQ(test, ec_read_memmap_snapshot(data, &snap), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->readmems), 10);
+	KUNIT_EXPECT_EQ(test, data->memmap.hits, 0);
+}
+
+static void fw_test_memmap_error(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct fw_memmap_snapshot snap;
+
+	memmap_cache_ms = 60000;
+	fake->readmem_error = -EIO;
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, ec_read_memmap_snapshot(data, &snap), -EIO);
+	KUNIT_EXPECT_FALSE(test, data->memmap.valid);
+
+	// A failed read leaves nothing behind to be served from the cache
+	fake->readmem_error = 0;
+	KUNIT_EXPECT_EQ(test, ec_read_memmap_snapshot(data, &snap), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->readmems), 2);
+}
+
+static void fw_test_count_fans(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	size_t count;
+
+	KUNIT_EXPECT_EQ(test, data->fan_count, 1);
+
+	memmap_cache_ms = 0;
+	fw_fake_ec_set_fan(fake, 1, 1500);
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, ec_count_fans(data, &count), 0);
+	KUNIT_EXPECT_EQ(test, count, 2);
+
+	for (size_t i = 0; i < EC_FAN_SPEED_ENTRIES; i++)
+		fw_fake_ec_set_fan(fake, i, 1000);
+	KUNIT_EXPECT_EQ(test, ec_count_fans(data, &count), 0);
+	KUNIT_EXPECT_EQ(test, count, EC_FAN_SPEED_ENTRIES);
+	mutex_unlock(&data->lock);
+}
+
+// Sensors are found and named at probe time, broken ones still count
+static void fw_test_temp_init(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fw_fake_ec_set_temp(fake, 2, EC_TEMP_SENSOR_ERROR);
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, framework_temp_init(data), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, data->temp_present, BIT(0) | BIT(2));
+	KUNIT_EXPECT_STREQ(test, data->temp_labels[0], "fake0");
+	KUNIT_EXPECT_STREQ(test, data->temp_labels[2], "fake2");
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_TEMP_SENSOR_GET_INFO),
+			2);
+}
+
+// --- fan shadow registers ---
+
+static void fw_test_fan_duty_suppressed(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fan_force_write = false;
+
+	mutex_lock(&data->lock);
+	for (int i = 0; i < 5; i++)
+		KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_DUTY),
+			1);
+	KUNIT_EXPECT_EQ(test, data->shadows[0].duty_suppressed, 4);
+	KUNIT_EXPECT_EQ(test, fake->fan_duty[0], 50);
+	KUNIT_EXPECT_EQ(test, fake->last_version, 1);
+}
+
+// A target RPM or automatic control replaces the duty cycle on the EC, so
+// the same duty has to be written again afterwards
+static void fw_test_fan_shadow_invalidated(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fan_force_write = false;
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_target(data, 0, 3000), 0);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_target(data, 0, 3000), 0);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_auto(data, 0), 0);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_DUTY),
+			3);
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_TARGET_RPM),
+			1);
+	KUNIT_EXPECT_EQ(test, data->shadows[0].target_suppressed, 1);
+	KUNIT_EXPECT_FALSE(test, fake->fan_auto[0]);
+}
+
+static void fw_test_fan_force_write(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fan_force_write = true;
+
+	mutex_lock(&data->lock);
+	for (int i = 0; i < 3; i++)
+		KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_DUTY),
+			3);
+	KUNIT_EXPECT_EQ(test, data->shadows[0].duty_suppressed, 0);
+}
+
+// A failed write must not be remembered as the EC's state
+static void fw_test_fan_duty_error(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fan_force_write = false;
+	fake->fail_command = EC_CMD_PWM_SET_FAN_DUTY;
+	fake->fail_result = EC_RES_ERROR;
+
+	mutex_lock(&data->lock);
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), -EIO);
+	fake->fail_command = 0;
+	KUNIT_EXPECT_EQ(test, fw_fan_set_duty(data, 0, 50), 0);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_DUTY),
+			2);
+	KUNIT_EXPECT_EQ(test, fake->fan_duty[0], 50);
+}
+
+// Out of range duty cycles never reach the EC, and a failed write leaves the
+// fan under its previous control
+static void fw_test_pwm_input(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct device *dev = &data->pdev->dev;
+
+	data->shadows[0].mode = FW_PWM_ENABLE_AUTO;
+
+	KUNIT_EXPECT_EQ(test,
+			fw_hwmon_write(dev, hwmon_pwm, hwmon_pwm_input, 0, 101),
+			-EINVAL);
+
+	fake->fail_command = EC_CMD_PWM_SET_FAN_DUTY;
+	fake->fail_result = EC_RES_ERROR;
+	KUNIT_EXPECT_EQ(test,
+			fw_hwmon_write(dev, hwmon_pwm, hwmon_pwm_input, 0, 50),
+			-EIO);
+	KUNIT_EXPECT_EQ(test, data->shadows[0].mode, FW_PWM_ENABLE_AUTO);
+
+	fake->fail_command = 0;
+	KUNIT_EXPECT_EQ(test,
+			fw_hwmon_write(dev, hwmon_pwm, hwmon_pwm_input, 0, 50),
+			0);
+	KUNIT_EXPECT_EQ(test, data->shadows[0].mode, FW_PWM_ENABLE_MANUAL);
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_SET_FAN_DUTY),
+			2);
+}
+
+// --- keyboard backlight ---
+
+static void fw_test_kb_led_coalesced(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	// A flush just happened, so everything below lands in the next one
+	kb_led_interval_ms = 60000;
+	WRITE_ONCE(data->kb_led_last_flush, jiffies);
+
+	for (int i = 0; i <= 100; i++)
+		kb_led_set_async(&data->kb_led, i);
+	KUNIT_EXPECT_EQ(test, kb_led_get(&data->kb_led), 100);
+
+	flush_delayed_work(&data->kb_led_work);
+
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake,
+					    EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT),
+			1);
+	KUNIT_EXPECT_EQ(test, fake->kb_percent, 100);
+}
+
+// Brightness changed by the hotkey is picked up, but never over a write
+// that is still waiting to be flushed
+static void fw_test_kb_led_sync(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	kb_led_interval_ms = 60000;
+	WRITE_ONCE(data->kb_led_last_flush, jiffies);
+
+	kb_led_set_async(&data->kb_led, 40);
+	fake->kb_percent = 70;
+	schedule_work(&data->kb_led_sync_work);
+	flush_work(&data->kb_led_sync_work);
+	KUNIT_EXPECT_EQ(test, kb_led_get(&data->kb_led), 40);
+
+	flush_delayed_work(&data->kb_led_work);
+	KUNIT_EXPECT_EQ(test, fake->kb_percent, 40);
+
+	fake->kb_percent = 70;
+	schedule_work(&data->kb_led_sync_work);
+	flush_work(&data->kb_led_sync_work);
+	KUNIT_EXPECT_EQ(test, kb_led_get(&data->kb_led), 70);
+}
+
+// A rejected write puts the EC's brightness back into the cache
+static void fw_test_kb_led_write_error(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+
+	fake->fail_command = EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT;
+	fake->fail_result = EC_RES_ERROR;
+
+	kb_led_set_async(&data->kb_led, 30);
+	flush_delayed_work(&data->kb_led_work);
+	flush_work(&data->kb_led_sync_work);
+
+	KUNIT_EXPECT_EQ(test, kb_led_get(&data->kb_led), 50);
+	KUNIT_EXPECT_EQ(test, fw_fake_ec_commands(fake, EC_CMD_PWM_GET_DUTY), 1);
+}
+
+// --- fan monitoring ---
+
+static void fw_test_fan_stall_debounced(struct kunit *test)
+{
+	struct fw_fan_monitor mon = {};
+	bool alarm, fault;
+
+	fan_stall_debounce = 3;
+
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_STALLED, 100, &alarm, &fault);
+	KUNIT_EXPECT_FALSE(test, alarm);
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_STALLED, 200, &alarm, &fault);
+	KUNIT_EXPECT_FALSE(test, alarm);
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_STALLED, 300, &alarm, &fault);
+	KUNIT_EXPECT_TRUE(test, alarm);
+	KUNIT_EXPECT_TRUE(test, mon.stalled);
+	KUNIT_EXPECT_EQ(test, mon.episodes, 1);
+
+	// The alarm stays latched after the fan recovers
+	fw_fan_monitor_update(&mon, 1200, 1000, &alarm, &fault);
+	KUNIT_EXPECT_FALSE(test, alarm);
+	KUNIT_EXPECT_TRUE(test, mon.alarm);
+	KUNIT_EXPECT_FALSE(test, mon.stalled);
+	KUNIT_EXPECT_EQ(test, mon.stall_total_ns, 900);
+	KUNIT_EXPECT_EQ(test, mon.stall_max_ns, 900);
+	KUNIT_EXPECT_FALSE(test, fault);
+}
+
+static void fw_test_fan_stall_glitch(struct kunit *test)
+{
+	struct fw_fan_monitor mon = {};
+	bool alarm, fault;
+
+	fan_stall_debounce = 2;
+
+	for (int i = 0; i < 5; i++) {
+		fw_fan_monitor_update(&mon, EC_FAN_SPEED_STALLED, i, &alarm,
+				      &fault);
+		KUNIT_EXPECT_FALSE(test, alarm);
+		fw_fan_monitor_update(&mon, 1200, i, &alarm, &fault);
+	}
+
+	KUNIT_EXPECT_FALSE(test, mon.alarm);
+	KUNIT_EXPECT_EQ(test, mon.episodes, 0);
+}
+
+static void fw_test_fan_fault(struct kunit *test)
+{
+	struct fw_fan_monitor mon = {};
+	bool alarm, fault;
+
+	fan_stall_debounce = 2;
+
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_NOT_PRESENT, 0, &alarm, &fault);
+	KUNIT_EXPECT_FALSE(test, fault);
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_NOT_PRESENT, 1, &alarm, &fault);
+	KUNIT_EXPECT_TRUE(test, fault);
+	fw_fan_monitor_update(&mon, EC_FAN_SPEED_NOT_PRESENT, 2, &alarm, &fault);
+	KUNIT_EXPECT_FALSE(test, fault);
+	KUNIT_EXPECT_TRUE(test, mon.fault);
+
+	// Unlike the alarm, a fault clears as soon as the fan is back
+	fw_fan_monitor_update(&mon, 1200, 3, &alarm, &fault);
+	KUNIT_EXPECT_TRUE(test, fault);
+	KUNIT_EXPECT_FALSE(test, mon.fault);
+	KUNIT_EXPECT_FALSE(test, alarm);
+}
+
+// --- telemetry ---
+
+static void fw_test_telemetry_fill(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct framework_laptop_telemetry *t = data->telemetry;
+
+	fw_fake_ec_set_temp(fake, 1, EC_TEMP_SENSOR_ERROR);
+	data->temp_present = BIT(0) | BIT(1);
+
+	mutex_lock(&data->lock);
+	fw_telemetry_fill(data);
+	KUNIT_EXPECT_EQ(test, t->seq, 2);
+	fw_telemetry_fill(data);
+	KUNIT_EXPECT_EQ(test, t->seq, 4);
+	mutex_unlock(&data->lock);
+
+	KUNIT_EXPECT_EQ(test, t->fan_count, 1);
+	KUNIT_EXPECT_EQ(test, t->fan_rpm[0], 2000);
+	KUNIT_EXPECT_EQ(test, t->fan_rpm[1], FRAMEWORK_LAPTOP_FAN_NOT_PRESENT);
+	KUNIT_EXPECT_EQ(test, t->temp_valid, BIT(0));
+	KUNIT_EXPECT_EQ(test, t->temp[0], kelvin_to_millicelsius(300));
+	KUNIT_EXPECT_EQ(test, t->charge_limit, 100);
+	KUNIT_EXPECT_EQ(test, t->kb_brightness, 50);
+
+	// Both fills are served from the caches after the first
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake, EC_CMD_CHARGE_LIMIT_CONTROL),
+			1);
+}
+
+// --- batched operations ---
+
+static struct framework_laptop_batch *fw_test_batch(struct kunit *test)
+{
+	struct framework_laptop_batch *batch;
+
+	batch = kunit_kzalloc(test, sizeof(*batch), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, batch);
+
+	return batch;
+}
+
+static void fw_test_batch_one_lock(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct framework_laptop_batch *batch = fw_test_batch(test);
+
+	fan_force_write = false;
+
+	batch->count = 4;
+	batch->ops[0] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_SET_CHARGE_LIMIT, .value = 80 };
+	batch->ops[1] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_SET_FAN_DUTY, .value = 50 };
+	batch->ops[2] = batch->ops[1];
+	batch->ops[3] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_READ_SNAPSHOT };
+
+	fw_batch_run(data, true, batch);
+
+	for (u32 i = 0; i < batch->count; i++)
+		KUNIT_EXPECT_EQ(test, batch->ops[i].result, 0);
+
+	// The snapshot sees the limit that was just written
+	KUNIT_EXPECT_EQ(test, batch->snapshot.charge_limit, 80);
+	KUNIT_EXPECT_EQ(test, batch->snapshot.fan_rpm[0], 2000);
+
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->xfers), 2);
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->readmems), 1);
+	KUNIT_EXPECT_EQ(test, fake->charge_limit, 80);
+	KUNIT_EXPECT_EQ(test, fake->fan_duty[0], 50);
+}
+
+static void fw_test_batch_stop_on_error(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct framework_laptop_batch *batch = fw_test_batch(test);
+
+	batch->count = 2;
+	batch->flags = FRAMEWORK_LAPTOP_BATCH_STOP_ON_ERROR;
+	batch->ops[0] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_SET_CHARGE_LIMIT, .value = 101 };
+	batch->ops[1] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_SET_FAN_DUTY, .value = 50 };
+
+	fw_batch_run(data, true, batch);
+
+	KUNIT_EXPECT_EQ(test, batch->ops[0].result, -EINVAL);
+	KUNIT_EXPECT_EQ(test, batch->ops[1].result, -ECANCELED);
+	KUNIT_EXPECT_EQ(test, atomic_read(&fake->xfers), 0);
+}
+
+static void fw_test_batch_read_only(struct kunit *test)
+{
+	struct framework_data *data = fw_test_data(test);
+	struct fw_fake_ec *fake = fw_test_ec(test);
+	struct framework_laptop_batch *batch = fw_test_batch(test);
+
+	batch->count = 2;
+	batch->ops[0] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_SET_KB_BRIGHTNESS, .value = 10 };
+	batch->ops[1] = (struct framework_laptop_op){
+		.type = FRAMEWORK_LAPTOP_OP_READ_SNAPSHOT };
+
+	fw_batch_run(data, false, batch);
+
+	KUNIT_EXPECT_EQ(test, batch->ops[0].result, -EPERM);
+	KUNIT_EXPECT_EQ(test, batch->ops[1].result, 0);
+	KUNIT_EXPECT_EQ(test,
+			fw_fake_ec_commands(fake,
+					    EC_CMD_PWM_SET_KEYBOARD_BACKLIGHT),
+			0);
+}
+
+static struct kunit_case framework_laptop_test_cases[] = {
+	KUNIT_CASE(fw_test_caps_query_once),
+	KUNIT_CASE(fw_test_caps_unsupported),
+	KUNIT_CASE(fw_test_caps_old_ec),
+	KUNIT_CASE(fw_test_fan_cmd_v0),
+	KUNIT_CASE(fw_test_charge_limit_cached),
+	KUNIT_CASE(fw_test_charge_limit_write_through),
+	KUNIT_CASE(fw_test_charge_limit_error),
+	KUNIT_CASE(fw_test_latency_recorded),
+	KUNIT_CASE(fw_test_memmap_cached),
+	KUNIT_CASE(fw_test_memmap_uncached),
+	KUNIT_CASE(fw_test_memmap_error),
+	KUNIT_CASE(fw_test_count_fans),
+	KUNIT_CASE(fw_test_temp_init),
+	KUNIT_CASE(fw_test_fan_duty_suppressed),
+	KUNIT_CASE(fw_test_fan_shadow_invalidated),
+	KUNIT_CASE(fw_test_fan_force_write),
+	KUNIT_CASE(fw_test_fan_duty_error),
+	KUNIT_CASE(fw_test_pwm_input),
+	KUNIT_CASE(fw_test_kb_led_coalesced),
+	KUNIT_CASE(fw_test_kb_led_sync),
+	KUNIT_CASE(fw_test_kb_led_write_error),
+	KUNIT_CASE(fw_test_fan_stall_debounced),
+	KUNIT_CASE(fw_test_fan_stall_glitch),
+	KUNIT_CASE(fw_test_fan_fault),
+	KUNIT_CASE(fw_test_telemetry_fill),
+	KUNIT_CASE(fw_test_batch_one_lock),
+	KUNIT_CASE(fw_test_batch_stop_on_error),
+	KUNIT_CASE(fw_test_batch_read_only),
+	{}
+};
+
+static struct kunit_suite framework_laptop_test_suite = {
+	.name = "framework_laptop",
+	.init = fw_test_init,
+	.exit = fw_test_exit,
+	.test_cases = framework_laptop_test_cases,
+};
+kunit_test_suite(framework_laptop_test_suite);
+
+MODULE_DESCRIPTION("Framework Laptop Platform Driver KUnit tests");
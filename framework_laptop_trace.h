@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Framework Laptop ACPI Driver tracepoints
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+#undef TRACE_SYSTEM
+// The tests, benchmark and fake EC build carry their own copy of the events
+#if defined(FRAMEWORK_LAPTOP_FAKE)
+#define TRACE_SYSTEM framework_laptop_fake
+#elif defined(FRAMEWORK_LAPTOP_BENCH)
+#define TRACE_SYSTEM framework_laptop_bench
+#elif defined(FRAMEWORK_LAPTOP_KUNIT)
+#define TRACE_SYSTEM framework_laptop_kunit
+#else
+#define TRACE_SYSTEM framework_laptop
+#endif
+
+#if !defined(_FRAMEWORK_LAPTOP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _FRAMEWORK_LAPTOP_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/types.h>
+
+TRACE_EVENT(ec_cmd_start,
+	TP_PROTO(u32 command, u32 version, u32 outsize, u32 insize),
+	TP_ARGS(command, version, outsize, insize),
+	TP_STRUCT__entry(
+		__field(u32, command)
+		__field(u32, version)
+		__field(u32, outsize)
+		__field(u32, insize)
+	),
+	TP_fast_assign(
+		__entry->command = command;
+		__entry->version = version;
+		__entry->outsize = outsize;
+		__entry->insize = insize;
+	),
+	TP_printk("command=0x%04x version=%u outsize=%u insize=%u",
+		  __entry->command, __entry->version, __entry->outsize,
+		  __entry->insize)
+);
+
+TRACE_EVENT(ec_cmd_end,
+	TP_PROTO(u32 command, u32 version, u32 outsize, u32 insize, int ret,
+		 u64 duration_ns),
+	TP_ARGS(command, version, outsize, insize, ret, duration_ns),
+	TP_STRUCT__entry(
+		__field(u32, command)
+		__field(u32, version)
+		__field(u32, outsize)
+		__field(u32, insize)
+		__field(int, ret)
+		__field(u64, duration_ns)
+	),
+	TP_fast_assign(
+		__entry->command = command;
+		__entry->version = version;
+		__entry->outsize = outsize;
+		__entry->insize = insize;
+		__entry->ret = ret;
+		__entry->duration_ns = duration_ns;
+	),
+	TP_printk("command=0x%04x version=%u outsize=%u insize=%u ret=%d duration_ns=%llu",
+		  __entry->command, __entry->version, __entry->outsize,
+		  __entry->insize, __entry->ret, __entry->duration_ns)
+);
+
+TRACE_EVENT(ec_readmem,
+	TP_PROTO(u32 offset, u32 bytes, int ret, u64 duration_ns),
+	TP_ARGS(offset, bytes, ret, duration_ns),
+	TP_STRUCT__entry(
+		__field(u32, offset)
+		__field(u32, bytes)
+		__field(int, ret)
+		__field(u64, duration_ns)
+	),
+	TP_fast_assign(
+		__entry->offset = offset;
+		__entry->bytes = bytes;
+		__entry->ret = ret;
+		__entry->duration_ns = duration_ns;
+	),
+	TP_printk("offset=0x%02x bytes=%u ret=%d duration_ns=%llu",
+		  __entry->offset, __entry->bytes, __entry->ret,
+		  __entry->duration_ns)
+);
+
+#endif /* _FRAMEWORK_LAPTOP_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE framework_laptop_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,546 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Framework Laptop ACPI Driver sysfs stress test
+ *
+ * Copyright (C) 2022 Dustin L. Howett
+ */
+
+// Hammers the driver's sysfs attributes from many threads at once and
+// reports the latency of every read(2) and write(2) it made.
+//
+// Writes only ever store the value an attribute had when the run started,
+// so the machine is left as it was found. pwmN and fanN_target are only
+// read, as writing them takes the fan out of automatic control; a pwmN
+// that has never been set reads as ENODATA, which shows up as errors.
+// fanN_alarm is read like any other attribute, so a stall that ended is
+// acknowledged during the run, as any monitoring daemon would.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DRV_NAME "framework_laptop"
+
+#define MAX_ATTRS 128
+#define VALUE_MAX 64
+
+// Latencies in ns go into 16 buckets per power of two, good to ~6%
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS (64 << SUB_BITS)
+
+enum op { OP_READ, OP_WRITE, OP_COUNT };
+
+static const char *const op_names[OP_COUNT] = { "read", "write" };
+
+struct attr {
+	char name[64];
+	char path[256];
+	bool writable; // safe to write back, and --writes asked for it
+	char value[VALUE_MAX]; // as read at start
+	size_t value_len;
+};
+
+struct hist {
+	uint64_t count;
+	uint64_t errors;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[BUCKETS];
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned int id;
+	unsigned int seed;
+	int fds[MAX_ATTRS];
+	struct hist hists[MAX_ATTRS][OP_COUNT];
+};
+
+static struct attr attrs[MAX_ATTRS];
+static size_t nr_attrs;
+
+static unsigned int threads = 4;
+static unsigned int duration_s = 10;
+static unsigned int write_pct;
+static const char *filter;
+static bool json;
+
+static atomic_bool stop;
+static atomic_bool failed;
+
+// --- histograms ---
+
+static unsigned int bucket_of(uint64_t ns)
+{
+	unsigned int msb, shift;
+
+	if (ns < SUB_BUCKETS)
+		return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	shift = msb - SUB_BITS;
+
+	return ((shift + 1) << SUB_BITS) + ((ns >> shift) & (SUB_BUCKETS - 1));
+}
+
+// Lowest latency that lands in a bucket
+static uint64_t bucket_ns(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	shift = (bucket >> SUB_BITS) - 1;
+
+	return (uint64_t)(SUB_BUCKETS | (bucket & (SUB_BUCKETS - 1))) << shift;
+}
+
+static void hist_add(struct hist *h, uint64_t ns, bool error)
+{
+	h->count++;
+	if (error)
+		h->errors++;
+	h->total_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->buckets[bucket_of(ns)]++;
+}
+
+static void hist_merge(struct hist *into, const struct hist *h)
+{
+	into->count += h->count;
+	into->errors += h->errors;
+	into->total_ns += h->total_ns;
+	if (h->max_ns > into->max_ns)
+		into->max_ns = h->max_ns;
+	for (size_t i = 0; i < BUCKETS; i++)
+		into->buckets[i] += h->buckets[i];
+}
+
+static uint64_t hist_percentile(const struct hist *h, unsigned int permille)
+{
+	uint64_t rank = (h->count * permille + 999) / 1000;
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank && seen)
+			return bucket_ns(i);
+	}
+
+	return h->max_ns;
+}
+
+// --- attribute discovery ---
+
+static bool read_value(const char *path, char *buf, size_t size, size_t *len)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	ret = read(fd, buf, size - 1);
+	close(fd);
+	if (ret < 0)
+		return false;
+
+	buf[ret] = '\0';
+	*len = ret;
+
+	return true;
+}
+
+static void add_attr(const char *name, const char *path, bool may_write)
+{
+	struct attr *a;
+	int fd;
+
+	if (nr_attrs == MAX_ATTRS || (filter && !strstr(name, filter)))
+		return;
+
+	a = &attrs[nr_attrs];
+	snprintf(a->name, sizeof(a->name), "%s", name);
+	snprintf(a->path, sizeof(a->path), "%s", path);
+
+	// Written back only if it could be read and opened for writing
+	if (may_write && write_pct &&
+	    read_value(path, a->value, sizeof(a->value), &a->value_len)) {
+		fd = open(path, O_WRONLY);
+		if (fd >= 0) {
+			a->writable = true;
+			close(fd);
+		}
+	}
+
+	nr_attrs++;
+}
+
+static void add_glob(const char *pattern, const char *prefix, bool may_write)
+{
+	char name[64];
+	glob_t g;
+
+	if (glob(pattern, 0, NULL, &g))
+		return;
+
+	for (size_t i = 0; i < g.gl_pathc; i++) {
+		const char *base = strrchr(g.gl_pathv[i], '/') + 1;
+
+		snprintf(name, sizeof(name), "%s%s", prefix, base);
+		add_attr(name, g.gl_pathv[i], may_write);
+	}
+
+	globfree(&g);
+}
+
+static void discover(void)
+{
+	char path[256], hwmon_name[64];
+	size_t len;
+	glob_t g;
+
+	if (!glob("/sys/class/hwmon/hwmon*", 0, NULL, &g)) {
+		for (size_t i = 0; i < g.gl_pathc; i++) {
+			const char *dir = g.gl_pathv[i];
+
+			snprintf(path, sizeof(path), "%s/name", dir);
+			if (!read_value(path, hwmon_name, sizeof(hwmon_name),
+					&len) ||
+			    strcmp(hwmon_name, DRV_NAME "\n"))
+				continue;
+
+#define HWMON(pattern, may_write)                                             \
+	do {                                                                  \
+		snprintf(path, sizeof(path), "%s/" pattern, dir);             \
+		add_glob(path, "", may_write);                                \
+	} while (0)
+			HWMON("fan[0-9]_input", false);
+			HWMON("fan[0-9]_target", false);
+			HWMON("fan[0-9]_fault", false);
+			HWMON("fan[0-9]_alarm", false);
+			HWMON("pwm[0-9]", false);
+			HWMON("pwm[0-9]_enable", true);
+			HWMON("temp[0-9]*_input", false);
+			HWMON("temp[0-9]*_fault", false);
+			HWMON("temp[0-9]*_label", false);
+#undef HWMON
+		}
+		globfree(&g);
+	}
+
+	add_glob("/sys/class/power_supply/*/charge_control_end_threshold", "",
+		 true);
+	add_glob("/sys/class/leds/" DRV_NAME "::kbd_backlight/brightness",
+		 "kbd_backlight/", true);
+	add_glob("/sys/bus/platform/devices/" DRV_NAME "/framework_privacy", "",
+		 false);
+}
+
+// --- workers ---
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Every worker opens its own files, a shared one would serialize the
+// threads in kernfs before they ever reach the driver
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t opened = 0;
+	char buf[4096];
+
+	for (size_t i = 0; i < nr_attrs; i++) {
+		w->fds[i] = open(attrs[i].path,
+				 attrs[i].writable ? O_RDWR : O_RDONLY);
+		if (w->fds[i] >= 0)
+			opened++;
+	}
+
+	// Nothing to do, and the loop below would spin on the stop flag
+	if (!opened) {
+		fprintf(stderr, "worker %u: could not open any attribute: %s\n",
+			w->id, strerror(errno));
+		atomic_store(&failed, true);
+		atomic_store(&stop, true);
+		return NULL;
+	}
+
+	// Each worker starts on a different attribute
+	for (size_t i = w->id; !atomic_load_explicit(&stop,
+						      memory_order_relaxed);
+	     i++) {
+		struct attr *a = &attrs[i % nr_attrs];
+		int fd = w->fds[i % nr_attrs];
+		enum op op = OP_READ;
+		uint64_t start;
+		ssize_t ret;
+
+		if (fd < 0)
+			continue;
+		if (a->writable && (unsigned int)rand_r(&w->seed) % 100 <
+					   write_pct)
+			op = OP_WRITE;
+
+		start = now_ns();
+		if (op == OP_WRITE)
+			ret = pwrite(fd, a->value, a->value_len, 0);
+		else
+			ret = pread(fd, buf, sizeof(buf), 0);
+		hist_add(&w->hists[i % nr_attrs][op], now_ns() - start,
+			 ret < 0);
+	}
+
+	for (size_t i = 0; i < nr_attrs; i++) {
+		if (w->fds[i] >= 0)
+			close(w->fds[i]);
+	}
+
+	return NULL;
+}
+
+// --- output ---
+
+static void print_csv(struct hist (*totals)[OP_COUNT], double elapsed_s)
+{
+	printf("attribute,op,count,errors,ops_per_sec,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+
+	for (size_t i = 0; i < nr_attrs; i++) {
+		for (size_t op = 0; op < OP_COUNT; op++) {
+			const struct hist *h = &totals[i][op];
+
+			if (!h->count)
+				continue;
+
+			printf("%s,%s,%llu,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+			       attrs[i].name, op_names[op],
+			       (unsigned long long)h->count,
+			       (unsigned long long)h->errors,
+			       h->count / elapsed_s,
+			       (unsigned long long)(h->total_ns / h->count),
+			       (unsigned long long)hist_percentile(h, 500),
+			       (unsigned long long)hist_percentile(h, 900),
+			       (unsigned long long)hist_percentile(h, 990),
+			       (unsigned long long)hist_percentile(h, 999),
+			       (unsigned long long)h->max_ns);
+		}
+	}
+}
+
+static void print_json(struct hist (*totals)[OP_COUNT], double elapsed_s)
+{
+	bool first = true;
+
+	printf("{\n  \"threads\": %u,\n  \"duration_s\": %.3f,\n  \"write_pct\": %u,\n  \"results\": [",
+	       threads, elapsed_s, write_pct);
+
+	for (size_t i = 0; i < nr_attrs; i++) {
+		for (size_t op = 0; op < OP_COUNT; op++) {
+			const struct hist *h = &totals[i][op];
+			bool first_bucket = true;
+
+			if (!h->count)
+				continue;
+
+			printf("%s\n    {\"attribute\": \"%s\", \"op\": \"%s\", \"count\": %llu, \"errors\": %llu, \"ops_per_sec\": %.0f, \"mean_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu,\n     \"histogram\": [",
+			       first ? "" : ",", attrs[i].name, op_names[op],
+			       (unsigned long long)h->count,
+			       (unsigned long long)h->errors,
+			       h->count / elapsed_s,
+			       (unsigned long long)(h->total_ns / h->count),
+			       (unsigned long long)hist_percentile(h, 500),
+			       (unsigned long long)hist_percentile(h, 900),
+			       (unsigned long long)hist_percentile(h, 990),
+			       (unsigned long long)hist_percentile(h, 999),
+			       (unsigned long long)h->max_ns);
+			first = false;
+
+			// [lowest ns of the bucket, count], empty ones left out
+			for (size_t b = 0; b < BUCKETS; b++) {
+				if (!h->buckets[b])
+					continue;
+
+				printf("%s[%llu, %llu]", first_bucket ? "" : ", ",
+				       (unsigned long long)bucket_ns(b),
+				       (unsigned long long)h->buckets[b]);
+				first_bucket = false;
+			}
+			printf("]}");
+		}
+	}
+
+	printf("\n  ]\n}\n");
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	atomic_store(&stop, true);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -t, --threads N      worker threads (default 4)\n"
+		"  -d, --duration S     seconds to run (default 10)\n"
+		"  -w, --writes PCT     percentage of writes to writable attributes (default 0)\n"
+		"  -a, --attr NAME      only attributes whose name contains NAME\n"
+		"  -f, --format FORMAT  csv or json (default csv)\n"
+		"  -l, --list           list the attributes found and exit\n",
+		argv0);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "threads", required_argument, NULL, 't' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "writes", required_argument, NULL, 'w' },
+		{ "attr", required_argument, NULL, 'a' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "list", no_argument, NULL, 'l' },
+		{ "help", no_argument, NULL, 'h' },
+		{}
+	};
+	struct hist (*totals)[OP_COUNT];
+	struct worker *workers;
+	uint64_t start, deadline;
+	double elapsed_s;
+	bool list = false;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "t:d:w:a:f:lh", options,
+				  NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration_s = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			write_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			filter = optarg;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "json"))
+				json = true;
+			else if (strcmp(optarg, "csv"))
+				goto bad_usage;
+			break;
+		case 'l':
+			list = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			goto bad_usage;
+		}
+	}
+
+	if (!threads || write_pct > 100 || optind != argc)
+		goto bad_usage;
+
+	discover();
+	if (!nr_attrs) {
+		fprintf(stderr, "%s: no %s attributes found, is the module loaded?\n",
+			argv[0], DRV_NAME);
+		return 1;
+	}
+
+	if (list) {
+		for (size_t i = 0; i < nr_attrs; i++)
+			printf("%s\t%s\t%s\n", attrs[i].name,
+			       attrs[i].writable ? "rw" : "r", attrs[i].path);
+		return 0;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	totals = calloc(nr_attrs, sizeof(*totals));
+	if (!workers || !totals) {
+		perror("calloc");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	start = now_ns();
+	for (unsigned int i = 0; i < threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = i + 1;
+		errno = pthread_create(&workers[i].thread, NULL, worker_fn,
+				       &workers[i]);
+		if (errno) {
+			perror("pthread_create");
+			atomic_store(&stop, true);
+			threads = i;
+			break;
+		}
+	}
+
+	// In short steps, so that a failed worker ends the run early
+	deadline = start + (uint64_t)duration_s * 1000000000;
+	while (!atomic_load(&stop) && now_ns() < deadline) {
+		struct timespec tick = { .tv_nsec = 100000000 };
+
+		nanosleep(&tick, NULL);
+	}
+	atomic_store(&stop, true);
+
+	for (unsigned int i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		for (size_t a = 0; a < nr_attrs; a++) {
+			for (size_t op = 0; op < OP_COUNT; op++)
+				hist_merge(&totals[a][op],
+					   &workers[i].hists[a][op]);
+		}
+	}
+	elapsed_s = (now_ns() - start) / 1e9;
+
+	if (atomic_load(&failed)) {
+		free(totals);
+		free(workers);
+		return 1;
+	}
+
+	if (json)
+		print_json(totals, elapsed_s);
+	else
+		print_csv(totals, elapsed_s);
+
+	free(totals);
+	free(workers);
+
+	return 0;
+
+bad_usage:
+	usage(argv[0]);
+	return 2;
+}